@@ -0,0 +1,696 @@
+/*
+ * Benchmarks
+ *
+ * Generates documents from a fixed seed, parses them repeatedly and reports
+ * throughput. Pass workload names to run only those workloads.
+ *
+ * Options:
+ *   --seed N           seed of the documents, 1 by default
+ *   --save FILE        write the results to FILE, for use as a baseline
+ *   --baseline FILE    compare against the results in FILE, and fail if
+ *                      a workload got slower by more than the threshold
+ *   --threshold PCT    allowed slowdown against the baseline, 10 by default
+ *
+ * Results are saved as a JSON object that maps workload names to MB/s.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "c-json.h"
+
+typedef struct Buffer {
+        char *data;
+        size_t n_data;
+        size_t z_data;
+} Buffer;
+
+static void buffer_append(Buffer *b, const char *data, size_t n) {
+        if (b->n_data + n + 1 > b->z_data) {
+                b->z_data = c_max(b->z_data * 2, b->n_data + n + 1);
+                b->data = realloc(b->data, b->z_data);
+                assert(b->data);
+        }
+
+        memcpy(b->data + b->n_data, data, n);
+        b->n_data += n;
+        b->data[b->n_data] = '\0';
+}
+
+static void buffer_printf(Buffer *b, const char *format, ...) {
+        char line[256];
+        va_list args;
+        int n;
+
+        va_start(args, format);
+        n = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+
+        assert(n >= 0 && (size_t)n < sizeof(line));
+        buffer_append(b, line, n);
+}
+
+static void buffer_indent(Buffer *b, bool pretty, size_t depth) {
+        if (!pretty)
+                return;
+
+        buffer_append(b, "\n", 1);
+        for (size_t i = 0; i < depth; i += 1)
+                buffer_append(b, "    ", 4);
+}
+
+/* xorshift64, so that documents are identical across runs and hosts */
+static uint64_t bench_random(uint64_t *state) {
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+
+        return *state;
+}
+
+/*
+ * A small object with a nested array of numbers, at nesting depth
+ * @depth, formatted either compact or indented by four spaces.
+ */
+static void generate_record(Buffer *b, bool pretty, size_t depth, uint64_t *seed) {
+        const char *sep = pretty ? ": " : ":";
+
+        buffer_append(b, "{", 1);
+        buffer_indent(b, pretty, depth + 1);
+        buffer_printf(b, "\"id\"%s%" PRIu64 ",", sep, bench_random(seed) >> 16);
+        buffer_indent(b, pretty, depth + 1);
+        buffer_printf(b, "\"name\"%s\"user-%" PRIu64 "\",", sep, bench_random(seed) % 100000);
+        buffer_indent(b, pretty, depth + 1);
+        buffer_printf(b, "\"active\"%s%s,", sep, bench_random(seed) & 1 ? "true" : "false");
+        buffer_indent(b, pretty, depth + 1);
+        buffer_printf(b, "\"values\"%s[", sep);
+        for (size_t j = 0; j < 4; j += 1) {
+                if (j > 0)
+                        buffer_append(b, ",", 1);
+                buffer_indent(b, pretty, depth + 2);
+                buffer_printf(b, "%" PRIu64, bench_random(seed) % 1000);
+        }
+        buffer_indent(b, pretty, depth + 1);
+        buffer_append(b, "]", 1);
+        buffer_indent(b, pretty, depth);
+        buffer_append(b, "}", 1);
+}
+
+/* An array of records. */
+static void generate_records(Buffer *b, bool pretty, uint64_t seed, size_t n_records) {
+        buffer_append(b, "[", 1);
+        for (size_t i = 0; i < n_records; i += 1) {
+                if (i > 0)
+                        buffer_append(b, ",", 1);
+                buffer_indent(b, pretty, 1);
+                generate_record(b, pretty, 1, &seed);
+        }
+        buffer_indent(b, pretty, 0);
+        buffer_append(b, "]", 1);
+}
+
+/* Compact records, one per line. */
+static void generate_ndjson(Buffer *b, bool pretty, uint64_t seed, size_t n_records) {
+        for (size_t i = 0; i < n_records; i += 1) {
+                generate_record(b, false, 0, &seed);
+                buffer_append(b, "\n", 1);
+        }
+}
+
+/*
+ * An array of strings of 16 to 271 bytes, mostly ASCII text with some
+ * multi-byte characters and escape sequences mixed in.
+ */
+static void generate_strings(Buffer *b, bool pretty, uint64_t seed, size_t n_strings) {
+        static const char *const specials[] = { "\\n", "\\\"", "\\u00e9", "\xc3\xa9", "\xe2\x82\xac" };
+
+        buffer_append(b, "[", 1);
+        for (size_t i = 0; i < n_strings; i += 1) {
+                size_t n = 16 + bench_random(&seed) % 256;
+
+                if (i > 0)
+                        buffer_append(b, ",", 1);
+                buffer_indent(b, pretty, 1);
+                buffer_append(b, "\"", 1);
+                for (size_t j = 0; j < n; j += 1) {
+                        uint64_t x = bench_random(&seed);
+
+                        if (x % 64 == 0) {
+                                const char *special = specials[(x >> 8) % C_ARRAY_SIZE(specials)];
+
+                                buffer_append(b, special, strlen(special));
+                        } else {
+                                char c = x % 8 ? 'a' + (x >> 8) % 26 : ' ';
+
+                                buffer_append(b, &c, 1);
+                        }
+                }
+                buffer_append(b, "\"", 1);
+        }
+        buffer_indent(b, pretty, 0);
+        buffer_append(b, "]", 1);
+}
+
+/*
+ * An array of trees, each a chain of 64 single-member objects that
+ * alternate with single-element arrays, around a record.
+ */
+static void generate_nested(Buffer *b, bool pretty, uint64_t seed, size_t n_trees) {
+        buffer_append(b, "[", 1);
+        for (size_t i = 0; i < n_trees; i += 1) {
+                if (i > 0)
+                        buffer_append(b, ",", 1);
+                for (size_t j = 0; j < 64; j += 1)
+                        buffer_append(b, "{\"a\":[", 6);
+                generate_record(b, false, 0, &seed);
+                for (size_t j = 0; j < 64; j += 1)
+                        buffer_append(b, "]}", 2);
+        }
+        buffer_append(b, "]", 1);
+}
+
+/*
+ * A flat array of numbers with up to three decimals, like a time series.
+ */
+static void generate_numbers(Buffer *b, bool pretty, uint64_t seed, size_t n_numbers) {
+        buffer_append(b, "[", 1);
+        for (size_t i = 0; i < n_numbers; i += 1) {
+                if (i > 0)
+                        buffer_append(b, pretty ? ", " : ",", pretty ? 2 : 1);
+                buffer_printf(b, "%.3f", (double)(bench_random(&seed) % 10000000) / 1000);
+        }
+        buffer_append(b, "]", 1);
+}
+
+/* An array of doubles of all magnitudes, each with 17 significant digits. */
+static void generate_doubles(Buffer *b, bool pretty, uint64_t seed, size_t n_numbers) {
+        buffer_append(b, "[", 1);
+        for (size_t i = 0; i < n_numbers; i += 1) {
+                uint64_t r = bench_random(&seed);
+
+                if (i > 0)
+                        buffer_append(b, pretty ? ", " : ",", pretty ? 2 : 1);
+                buffer_printf(b, "%.17g", ldexp((double)(r >> 11), (int)(r % 400) - 253));
+        }
+        buffer_append(b, "]", 1);
+}
+
+/*
+ * Reads the next value and everything nested in it, and returns the
+ * number of values read.
+ */
+static size_t bench_read_value(CJson *json) {
+        size_t n_values = 1;
+        const char *string;
+        size_t n;
+
+        switch (c_json_peek(json)) {
+                case C_JSON_TYPE_NULL:
+                        assert(!c_json_read_null(json));
+                        break;
+
+                case C_JSON_TYPE_BOOLEAN:
+                        assert(!c_json_read_bool(json, NULL));
+                        break;
+
+                case C_JSON_TYPE_STRING:
+                        assert(!c_json_read_string_view(json, &string, &n));
+                        break;
+
+                case C_JSON_TYPE_NUMBER:
+                        assert(!c_json_read_f64(json, NULL));
+                        break;
+
+                case C_JSON_TYPE_ARRAY:
+                        assert(!c_json_open_array(json));
+                        while (c_json_more(json))
+                                n_values += bench_read_value(json);
+                        assert(!c_json_close_array(json));
+                        break;
+
+                case C_JSON_TYPE_OBJECT:
+                        assert(!c_json_open_object(json));
+                        while (c_json_more(json)) {
+                                assert(!c_json_read_string_view(json, &string, &n));
+                                n_values += bench_read_value(json);
+                        }
+                        assert(!c_json_close_object(json));
+                        break;
+
+                default:
+                        assert(0);
+        }
+
+        return n_values;
+}
+
+/*
+ * Reads all documents in the input, and returns the number of values
+ * read.
+ */
+static size_t bench_read_documents(CJson *json) {
+        size_t n_values = 0;
+        bool more;
+
+        for (;;) {
+                assert(!c_json_next_document(json, &more));
+                if (!more)
+                        break;
+                n_values += bench_read_value(json);
+        }
+
+        return n_values;
+}
+
+static void bench_read(CJson *json, const CJsonKeySet *set) {
+        bench_read_documents(json);
+}
+
+static void bench_skip(CJson *json, const CJsonKeySet *set) {
+        assert(!c_json_skip(json));
+}
+
+/* Reads only the "id" and "active" members of each record. */
+static void bench_find_keys(CJson *json, const CJsonKeySet *set) {
+        size_t index;
+
+        assert(!c_json_open_array(json));
+        while (c_json_more(json)) {
+                assert(!c_json_open_object(json));
+                for (;;) {
+                        assert(!c_json_find_keys(json, set, &index));
+                        if (index == C_JSON_KEY_NONE)
+                                break;
+                        else if (index == 0)
+                                assert(!c_json_read_u64(json, NULL));
+                        else
+                                assert(!c_json_read_bool(json, NULL));
+                }
+                assert(!c_json_close_object(json));
+        }
+        assert(!c_json_close_array(json));
+}
+
+/* Copies every key of each record, and compares it to pick the member. */
+static void bench_keys(CJson *json, const CJsonKeySet *set) {
+        char *key;
+
+        assert(!c_json_open_array(json));
+        while (c_json_more(json)) {
+                assert(!c_json_open_object(json));
+                while (c_json_more(json)) {
+                        assert(!c_json_read_string(json, &key));
+                        if (!strcmp(key, "id"))
+                                assert(!c_json_read_u64(json, NULL));
+                        else
+                                assert(!c_json_skip(json));
+                }
+                assert(!c_json_close_object(json));
+        }
+        assert(!c_json_close_array(json));
+}
+
+/* Like bench_keys(), but interns the keys and compares their IDs. */
+static void bench_symbols(CJson *json, const CJsonKeySet *set) {
+        _c_cleanup_(c_json_symbols_freep) CJsonSymbols *symbols = NULL;
+        size_t id;
+
+        assert(!c_json_symbols_new(&symbols, 1024));
+        assert(!c_json_symbols_add(symbols, "id", 2, NULL));
+        c_json_set_symbols(json, symbols);
+
+        assert(!c_json_open_array(json));
+        while (c_json_more(json)) {
+                assert(!c_json_open_object(json));
+                while (c_json_more(json)) {
+                        assert(!c_json_read_key(json, NULL, &id));
+                        if (id == 0)
+                                assert(!c_json_read_u64(json, NULL));
+                        else
+                                assert(!c_json_skip(json));
+                }
+                assert(!c_json_close_object(json));
+        }
+        assert(!c_json_close_array(json));
+
+        c_json_set_symbols(json, NULL);
+}
+
+static void bench_f64_array(CJson *json, const CJsonKeySet *set) {
+        double values[256];
+        size_t n;
+
+        assert(!c_json_open_array(json));
+        while (c_json_more(json))
+                assert(!c_json_read_f64_array(json, values, C_ARRAY_SIZE(values), &n));
+        assert(!c_json_close_array(json));
+}
+
+/* Reads an array of numbers, and writes each of them to a second document. */
+static void bench_write_f64(CJson *json, const CJsonKeySet *set) {
+        _c_cleanup_(c_json_freep) CJson *writer = NULL;
+        double values[256];
+        size_t n;
+
+        assert(!c_json_new(&writer, 256));
+        c_json_begin_write(writer, NULL, NULL);
+        assert(!c_json_write_open_array(writer));
+
+        assert(!c_json_open_array(json));
+        while (c_json_more(json)) {
+                assert(!c_json_read_f64_array(json, values, C_ARRAY_SIZE(values), &n));
+                for (size_t i = 0; i < n; i += 1)
+                        assert(!c_json_write_f64(writer, values[i]));
+        }
+        assert(!c_json_close_array(json));
+
+        assert(!c_json_write_close_array(writer));
+        assert(!c_json_end_write(writer, NULL, NULL));
+}
+
+static int bench_paths_read(void *userdata, CJson *json, size_t index) {
+        return index == 0 ? c_json_read_u64(json, NULL) : c_json_read_bool(json, NULL);
+}
+
+/* Reads the same members as bench_find_keys(), as paths. */
+static void bench_paths(CJson *json, const CJsonKeySet *set) {
+        _c_cleanup_(c_json_paths_freep) CJsonPaths *paths = NULL;
+
+        assert(!c_json_paths_new(&paths, (const char *[]){ "/*/id", "/*/active" }, 2));
+        assert(!c_json_find_paths(json, paths, bench_paths_read, NULL));
+}
+
+typedef struct BenchRecord {
+        uint64_t id;
+        char *name;
+        bool active;
+} BenchRecord;
+
+static const CJsonField bench_record_fields[] = {
+        C_JSON_FIELD("id", C_JSON_FIELD_U64, BenchRecord, id),
+        C_JSON_FIELD("name", C_JSON_FIELD_STRING, BenchRecord, name),
+        C_JSON_FIELD("active", C_JSON_FIELD_BOOL, BenchRecord, active),
+};
+
+/* Reads each record into a struct, with names allocated from the arena. */
+static void bench_struct(CJson *json, const CJsonKeySet *set) {
+        _c_cleanup_(c_json_struct_freep) CJsonStruct *desc = NULL;
+        BenchRecord record;
+
+        assert(!c_json_struct_new(&desc, bench_record_fields, C_ARRAY_SIZE(bench_record_fields)));
+
+        assert(!c_json_open_array(json));
+        while (c_json_more(json))
+                assert(!c_json_read_struct(json, desc, &record));
+        assert(!c_json_close_array(json));
+}
+
+/* Records the document, then reads "id" and "active" of each record. */
+static void bench_doc(CJson *json, const CJsonKeySet *set) {
+        _c_cleanup_(c_json_doc_freep) CJsonDoc *doc = NULL;
+        size_t i, end;
+        uint64_t id;
+        bool active;
+
+        assert(!c_json_doc_new(&doc));
+        assert(!c_json_doc_read(doc, json));
+
+        end = c_json_doc_next(doc, 0);
+        for (i = c_json_doc_child(doc, 0); i < end; i = c_json_doc_next(doc, i)) {
+                assert(!c_json_doc_get_u64(doc, c_json_doc_find_key(doc, i, "id", 2), &id));
+                assert(!c_json_doc_get_bool(doc, c_json_doc_find_key(doc, i, "active", 6), &active));
+        }
+}
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+typedef struct Result {
+        double mb_per_s;
+        double ns_per_value;
+} Result;
+
+/*
+ * Parses the document repeatedly for at least half a second and reports
+ * the fastest run, which is the least disturbed by the rest of the
+ * system. The values are counted by reading the document once up front.
+ */
+static Result bench_run(const Buffer *b,
+                        void (*read)(CJson *json, const CJsonKeySet *set),
+                        unsigned int flags) {
+        _c_cleanup_(c_json_key_set_freep) CJsonKeySet *set = NULL;
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        uint64_t start, now, best = UINT64_MAX;
+        static char arena[1 << 20];
+        size_t n_values;
+
+        assert(!c_json_new(&json, 256));
+        assert(!c_json_key_set_new(&set, (const char *[]){ "id", "active" }, 2));
+        c_json_set_flags(json, flags);
+
+        /* strings that are copied do not measure malloc() */
+        c_json_set_arena(json, arena, sizeof(arena), NULL, NULL);
+
+        c_json_begin_read_n(json, b->data, b->n_data);
+        n_values = bench_read_documents(json);
+        assert(!c_json_end_read(json));
+
+        start = bench_now();
+        do {
+                uint64_t begin = bench_now();
+
+                c_json_begin_read_n(json, b->data, b->n_data);
+                read(json, set);
+                assert(!c_json_end_read(json));
+
+                now = bench_now();
+                best = c_min(best, now - begin);
+        } while (now - start < 500000000ULL);
+
+        return (Result){
+                .mb_per_s = (double)b->n_data / 1e6 / (best / 1e9),
+                .ns_per_value = (double)best / n_values,
+        };
+}
+
+static const struct {
+        const char *name;
+        void (*generate)(Buffer *b, bool pretty, uint64_t seed, size_t n);
+        size_t n;
+        bool pretty;
+        void (*read)(CJson *json, const CJsonKeySet *set);
+        unsigned int flags;
+} workloads[] = {
+        { "compact", generate_records, 20000, false, bench_read },
+        { "pretty-printed", generate_records, 20000, true, bench_read },
+        { "strings", generate_strings, 20000, false, bench_read },
+        { "strings-utf8", generate_strings, 20000, false, bench_read, C_JSON_FLAG_UTF8 },
+        { "compact-utf8", generate_records, 20000, false, bench_read, C_JSON_FLAG_UTF8 },
+        { "nested", generate_nested, 2000, false, bench_read },
+        { "ndjson", generate_ndjson, 20000, false, bench_read },
+        { "skip", generate_records, 20000, true, bench_skip },
+        { "skip-trusted", generate_records, 20000, true, bench_skip, C_JSON_FLAG_TRUSTED },
+        { "find-keys", generate_records, 20000, true, bench_find_keys },
+        { "find-keys-trusted", generate_records, 20000, true, bench_find_keys, C_JSON_FLAG_TRUSTED },
+        { "paths", generate_records, 20000, true, bench_paths },
+        { "paths-trusted", generate_records, 20000, true, bench_paths, C_JSON_FLAG_TRUSTED },
+        { "struct", generate_records, 20000, true, bench_struct },
+        { "keys", generate_records, 20000, true, bench_keys },
+        { "symbols", generate_records, 20000, true, bench_symbols },
+        { "doc", generate_records, 20000, true, bench_doc },
+        { "indexed", generate_records, 20000, true, bench_read, C_JSON_FLAG_INDEX },
+        { "skip-indexed", generate_records, 20000, true, bench_skip, C_JSON_FLAG_INDEX },
+        { "skip-trusted-indexed", generate_records, 20000, true, bench_skip, C_JSON_FLAG_TRUSTED | C_JSON_FLAG_INDEX },
+        { "find-keys-indexed", generate_records, 20000, true, bench_find_keys, C_JSON_FLAG_INDEX },
+        { "f64", generate_numbers, 200000, true, bench_read },
+        { "f64-array", generate_numbers, 200000, true, bench_f64_array },
+        { "doubles-array", generate_doubles, 200000, true, bench_f64_array },
+        { "write-f64", generate_numbers, 200000, true, bench_write_f64 },
+        { "write-doubles", generate_doubles, 200000, true, bench_write_f64 },
+};
+
+static size_t bench_lookup(const char *name, size_t n_name) {
+        for (size_t i = 0; i < C_ARRAY_SIZE(workloads); i += 1)
+                if (strlen(workloads[i].name) == n_name && !memcmp(workloads[i].name, name, n_name))
+                        return i;
+
+        return C_ARRAY_SIZE(workloads);
+}
+
+/*
+ * Reads the MB/s of each workload from a file written by --save. Workloads
+ * that are missing from it are left at NAN, unknown ones are ignored.
+ */
+static int bench_load(const char *path, double *baseline) {
+        _c_cleanup_(c_fclosep) FILE *file = NULL;
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        const char *name;
+        size_t n_name, i;
+        int r;
+
+        file = fopen(path, "r");
+        if (!file)
+                return -errno;
+
+        r = c_json_new(&json, 256);
+        if (r)
+                return r;
+
+        r = c_json_begin_read_file(json, fileno(file));
+        if (r)
+                return r;
+
+        c_json_open_object(json);
+        while (c_json_more(json)) {
+                c_json_read_string_view(json, &name, &n_name);
+                i = bench_lookup(name, n_name);
+                if (i < C_ARRAY_SIZE(workloads))
+                        c_json_read_f64(json, &baseline[i]);
+                else
+                        c_json_skip(json);
+        }
+        c_json_close_object(json);
+
+        return c_json_end_read(json);
+}
+
+static int bench_flush(void *userdata, const char *data, size_t n_data) {
+        return fwrite(data, 1, n_data, userdata) == n_data ? 0 : -EIO;
+}
+
+static int bench_save(const char *path, const double *results) {
+        _c_cleanup_(c_fclosep) FILE *file = NULL;
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        int r;
+
+        file = fopen(path, "w");
+        if (!file)
+                return -errno;
+
+        r = c_json_new(&json, 256);
+        if (r)
+                return r;
+
+        c_json_begin_write(json, bench_flush, file);
+        c_json_write_open_object(json);
+        for (size_t i = 0; i < C_ARRAY_SIZE(workloads); i += 1) {
+                if (isnan(results[i]))
+                        continue;
+                c_json_write_string(json, workloads[i].name);
+                c_json_write_f64(json, results[i]);
+        }
+        c_json_write_close_object(json);
+
+        r = c_json_end_write(json, NULL, NULL);
+        if (r)
+                return r;
+
+        return fputc('\n', file) == EOF ? -EIO : 0;
+}
+
+int main(int argc, char **argv) {
+        static const struct option options[] = {
+                { "seed", required_argument, NULL, 's' },
+                { "save", required_argument, NULL, 'o' },
+                { "baseline", required_argument, NULL, 'b' },
+                { "threshold", required_argument, NULL, 't' },
+                {}
+        };
+        double baseline[C_ARRAY_SIZE(workloads)], results[C_ARRAY_SIZE(workloads)];
+        const char *save = NULL, *load = NULL;
+        double threshold = 10;
+        uint64_t seed = 1;
+        bool regressed = false;
+        int r, c;
+
+        while ((c = getopt_long(argc, argv, "", options, NULL)) >= 0) {
+                switch (c) {
+                        case 's':
+                                seed = strtoull(optarg, NULL, 0);
+                                /* xorshift never leaves 0 */
+                                if (!seed)
+                                        seed = 1;
+                                break;
+                        case 'o':
+                                save = optarg;
+                                break;
+                        case 'b':
+                                load = optarg;
+                                break;
+                        case 't':
+                                threshold = strtod(optarg, NULL);
+                                break;
+                        default:
+                                return 2;
+                }
+        }
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(workloads); i += 1) {
+                baseline[i] = NAN;
+                results[i] = NAN;
+        }
+
+        for (int i = optind; i < argc; i += 1) {
+                if (bench_lookup(argv[i], strlen(argv[i])) >= C_ARRAY_SIZE(workloads)) {
+                        fprintf(stderr, "unknown workload: %s\n", argv[i]);
+                        return 2;
+                }
+        }
+
+        if (load) {
+                r = bench_load(load, baseline);
+                if (r) {
+                        fprintf(stderr, "cannot read baseline %s: %d\n", load, r);
+                        return 2;
+                }
+        }
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(workloads); i += 1) {
+                Buffer b = {};
+                bool selected = optind >= argc;
+                Result result;
+
+                for (int j = optind; j < argc; j += 1)
+                        selected = selected || !strcmp(argv[j], workloads[i].name);
+                if (!selected)
+                        continue;
+
+                workloads[i].generate(&b, workloads[i].pretty, seed, workloads[i].n);
+                result = bench_run(&b, workloads[i].read, workloads[i].flags);
+                results[i] = result.mb_per_s;
+                free(b.data);
+
+                printf("%-22s %10.1f MB/s %8.2f ns/value",
+                       workloads[i].name, result.mb_per_s, result.ns_per_value);
+                if (!isnan(baseline[i])) {
+                        double change = (result.mb_per_s / baseline[i] - 1) * 100;
+
+                        printf(" %+7.1f%%", change);
+                        if (change < -threshold) {
+                                printf(" REGRESSED");
+                                regressed = true;
+                        }
+                }
+                printf("\n");
+        }
+
+        if (save) {
+                r = bench_save(save, results);
+                if (r) {
+                        fprintf(stderr, "cannot write %s: %d\n", save, r);
+                        return 2;
+                }
+        }
+
+        return regressed ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Amalgamation
+ *
+ * The whole library as a single translation unit. Building it like this
+ * lets the compiler inline across what are otherwise separate files,
+ * like the readers into c_json_read_struct() or the key set lookup into
+ * c_json_find_keys(), without relying on LTO. See the `amalgamation`
+ * build option.
+ *
+ * Programs that link the library statically can also compile this file
+ * as part of their own sources, or include it into the translation unit
+ * of their hot loop, so that small readers like c_json_more() and
+ * c_json_peek() are inlined into it. The exported functions are the same
+ * either way.
+ *
+ * Static functions and types of different files end up in one namespace
+ * here, so their names must be unique across the library.
+ */
+
+#include "c-json.c"
+#include "c-json-dispatch.c"
+#include "c-json-doc.c"
+#include "c-json-index.c"
+#include "c-json-keys.c"
+#include "c-json-number.c"
+#include "c-json-paths.c"
+#include "c-json-pool.c"
+#include "c-json-scan.c"
+#include "c-json-struct.c"
+#include "c-json-symbols.c"
+#include "c-json-writer.c"
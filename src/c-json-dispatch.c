@@ -0,0 +1,177 @@
+/*
+ * Record Dispatch
+ *
+ * Newline-delimited input is cut into one contiguous range of lines per
+ * worker thread, and each worker reads its records with its own reader.
+ * A JSON string cannot contain a raw newline, so every newline ends a
+ * record, and finding them needs no tracking of strings. A newline in
+ * what would be a string only occurs in invalid input, which then fails
+ * as two invalid records instead of one.
+ */
+
+#include <c-stdaux.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-json.h"
+
+typedef struct CJsonWorker {
+        const char *input;
+        const char *start;
+        const char *end;
+        size_t max_depth;
+        unsigned int flags;
+        CJsonRecordFn fn;
+        void *userdata;
+        size_t index;
+        size_t *failed;
+        int r;
+        pthread_t thread;
+} CJsonWorker;
+
+/*
+ * Records that @worker failed, unless a worker in front of it did. Only
+ * workers behind the first one that failed stop early.
+ */
+static void c_json_worker_fail(CJsonWorker *worker, int r) {
+        size_t failed = __atomic_load_n(worker->failed, __ATOMIC_RELAXED);
+
+        worker->r = r;
+        while (worker->index < failed &&
+               !__atomic_compare_exchange_n(worker->failed, &failed, worker->index,
+                                            false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+}
+
+static void *c_json_worker_run(void *userdata) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        CJsonWorker *worker = userdata;
+        const char *p, *eol;
+        bool more;
+        int r;
+
+        r = c_json_new(&json, worker->max_depth);
+        if (r) {
+                c_json_worker_fail(worker, r);
+                return NULL;
+        }
+
+        c_json_set_flags(json, worker->flags);
+
+        for (p = worker->start; p < worker->end; p = eol + (eol < worker->end)) {
+                if (__atomic_load_n(worker->failed, __ATOMIC_RELAXED) < worker->index)
+                        break;
+
+                eol = memchr(p, '\n', worker->end - p);
+                if (!eol)
+                        eol = worker->end;
+
+                c_json_begin_read_n(json, p, eol - p);
+
+                /* blank lines are not records */
+                r = c_json_next_document(json, &more);
+                if (!r && more)
+                        r = worker->fn(worker->userdata, json, p - worker->input);
+
+                c_json_reset(json);
+
+                if (r) {
+                        c_json_worker_fail(worker, r);
+                        break;
+                }
+        }
+
+        return NULL;
+}
+
+/**
+ * c_json_dispatch_lines() - read newline-delimited records in parallel
+ * @data:               input
+ * @n_data:             length of @data
+ * @n_workers:          number of worker threads
+ * @max_depth:          maximum nesting depth of the readers
+ * @flags:              C_JSON_FLAG_* values for the readers, or 0
+ * @fn:                 callback to read a record
+ * @userdata:           argument passed to @fn
+ *
+ * Splits @data into lines and calls @fn for each line that is not blank,
+ * from @n_workers threads at once. The lines are divided into contiguous
+ * ranges, so each thread sees its lines in order, but records of different
+ * ranges are read concurrently. @fn is called with a reader that has begun
+ * reading the record, and the byte offset of the record in @data. It
+ * typically reads a single value and calls c_json_end_read() to check
+ * that nothing follows it. The reader is reset after @fn returns, and
+ * belongs to the worker thread.
+ *
+ * If @fn returns anything but 0, that is returned for the first record in
+ * the input for which it does. Workers with ranges behind that record
+ * stop early, the others continue until they reach it.
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ *         the first non-zero value returned by @fn
+ *         -EINVAL if @n_workers is 0
+ */
+_c_public_ int c_json_dispatch_lines(const void *data,
+                                     size_t n_data,
+                                     size_t n_workers,
+                                     size_t max_depth,
+                                     unsigned int flags,
+                                     CJsonRecordFn fn,
+                                     void *userdata) {
+        _c_cleanup_(c_freep) CJsonWorker *workers = NULL;
+        const char *input = data, *end = input + n_data, *eol;
+        size_t n_started = 0, failed = n_workers;
+        int r = 0;
+
+        if (n_workers == 0)
+                return -EINVAL;
+
+        workers = calloc(n_workers, sizeof(*workers));
+        if (!workers)
+                return -ENOMEM;
+
+        /* each range ends behind a newline, or at the end of the input */
+        for (size_t i = 0; i < n_workers; i += 1) {
+                CJsonWorker *worker = &workers[i];
+
+                worker->input = input;
+                worker->start = i ? workers[i - 1].end : input;
+                worker->end = c_max(input + n_data / n_workers * (i + 1), worker->start);
+                if (i == n_workers - 1 || worker->end >= end) {
+                        worker->end = end;
+                } else {
+                        eol = memchr(worker->end, '\n', end - worker->end);
+                        worker->end = eol ? eol + 1 : end;
+                }
+
+                worker->max_depth = max_depth;
+                worker->flags = flags;
+                worker->fn = fn;
+                worker->userdata = userdata;
+                worker->index = i;
+                worker->failed = &failed;
+        }
+
+        if (n_workers == 1) {
+                c_json_worker_run(&workers[0]);
+                return workers[0].r;
+        }
+
+        for (n_started = 0; n_started < n_workers; n_started += 1) {
+                if (pthread_create(&workers[n_started].thread, NULL, c_json_worker_run, &workers[n_started])) {
+                        __atomic_store_n(&failed, n_started, __ATOMIC_RELAXED);
+                        r = -EAGAIN;
+                        break;
+                }
+        }
+
+        for (size_t i = 0; i < n_started; i += 1)
+                pthread_join(workers[i].thread, NULL);
+
+        for (size_t i = 0; i < n_started; i += 1)
+                if (workers[i].r)
+                        return workers[i].r;
+
+        return r;
+}
@@ -0,0 +1,464 @@
+/*
+ * Documents
+ *
+ * A document is a value that was read once, and recorded as a tape for
+ * random access. Each value takes one 64-bit entry, which holds the
+ * offset of the value in the input in its lower 32 bits. Containers take
+ * a second entry that holds the number of their elements, or members for
+ * objects, and hold the index of the entry behind their last descendant
+ * in the upper 32 bits of the first. The elements of a container follow
+ * its two entries in order, and the members of an object are recorded as
+ * a string entry for the key, followed by the value.
+ *
+ * The type of a value follows from its first byte, and its contents are
+ * only decoded when accessed, by a private reader that is moved to the
+ * offset of the value. Strings that contain no escape sequences are
+ * therefore never copied.
+ */
+
+#include <c-stdaux.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-json.h"
+#include "c-json-private.h"
+
+typedef struct CJsonDocLevel {
+        size_t index;
+        size_t n;
+} CJsonDocLevel;
+
+struct CJsonDoc {
+        const char *input;
+        size_t n_input;
+
+        uint64_t *tape;
+        size_t n_tape;
+        size_t z_tape;
+
+        /* containers that are still open while reading */
+        CJsonDocLevel *stack;
+        size_t z_stack;
+
+        CJson *reader;
+};
+
+/**
+ * c_json_doc_new() - allocate an empty document
+ * @docp:               return location
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ */
+_c_public_ int c_json_doc_new(CJsonDoc **docp) {
+        _c_cleanup_(c_json_doc_freep) CJsonDoc *doc = NULL;
+        int r;
+
+        doc = calloc(1, sizeof(*doc));
+        if (!doc)
+                return -ENOMEM;
+
+        r = c_json_new(&doc->reader, 0);
+        if (r)
+                return r;
+
+        *docp = doc;
+        doc = NULL;
+
+        return 0;
+}
+
+/**
+ * c_json_doc_free() - free a document
+ * @doc:                document to free, or NULL
+ *
+ * Return: NULL
+ */
+_c_public_ CJsonDoc * c_json_doc_free(CJsonDoc *doc) {
+        if (!doc)
+                return NULL;
+
+        c_json_free(doc->reader);
+        free(doc->stack);
+        free(doc->tape);
+        free(doc);
+
+        return NULL;
+}
+
+static int c_json_doc_push(CJsonDoc *doc, uint64_t entry) {
+        uint64_t *tape;
+        size_t z;
+
+        if (_c_unlikely_(doc->n_tape >= doc->z_tape)) {
+                if (doc->n_tape >= UINT32_MAX)
+                        return -EFBIG;
+
+                z = c_max(doc->z_tape * 2, (size_t)64);
+                tape = realloc(doc->tape, z * sizeof(*tape));
+                if (!tape)
+                        return -ENOMEM;
+
+                doc->tape = tape;
+                doc->z_tape = z;
+        }
+
+        doc->tape[doc->n_tape++] = entry;
+
+        return 0;
+}
+
+static int c_json_doc_open(CJsonDoc *doc, size_t n_stack, uint64_t offset) {
+        CJsonDocLevel *stack;
+        size_t z;
+        int r;
+
+        if (_c_unlikely_(n_stack >= doc->z_stack)) {
+                z = c_max(doc->z_stack * 2, (size_t)16);
+                stack = realloc(doc->stack, z * sizeof(*stack));
+                if (!stack)
+                        return -ENOMEM;
+
+                doc->stack = stack;
+                doc->z_stack = z;
+        }
+
+        doc->stack[n_stack] = (CJsonDocLevel){ .index = doc->n_tape };
+
+        r = c_json_doc_push(doc, offset);
+        if (r)
+                return r;
+
+        return c_json_doc_push(doc, 0);
+}
+
+static int c_json_doc_record(CJsonDoc *doc, CJson *json) {
+        size_t n_stack = 0;
+        CJsonDocLevel *top;
+        uint64_t offset;
+        int type, r;
+
+        for (;;) {
+                if (n_stack > 0 && !c_json_more(json)) {
+                        if (json->poison)
+                                return json->poison;
+
+                        top = &doc->stack[--n_stack];
+                        doc->tape[top->index] |= (uint64_t)doc->n_tape << 32;
+                        doc->tape[top->index + 1] = top->n;
+
+                        if (doc->input[(uint32_t)doc->tape[top->index]] == '[')
+                                r = c_json_close_array(json);
+                        else
+                                r = c_json_close_object(json);
+                        if (r)
+                                return r;
+
+                        if (n_stack == 0)
+                                return 0;
+
+                        continue;
+                }
+
+                offset = json->p - doc->input;
+
+                if (n_stack > 0 && json->state != ':')
+                        doc->stack[n_stack - 1].n += 1;
+
+                /* the tape never holds a key without its value */
+                type = c_json_peek(json);
+                if (type < 0 && json->state == ':')
+                        return (json->poison = C_JSON_E_INVALID_JSON);
+
+                switch (type) {
+                        case C_JSON_TYPE_ARRAY:
+                                r = c_json_open_array(json);
+                                if (r)
+                                        return r;
+
+                                r = c_json_doc_open(doc, n_stack++, offset);
+                                if (r)
+                                        return r;
+
+                                break;
+
+                        case C_JSON_TYPE_OBJECT:
+                                r = c_json_open_object(json);
+                                if (r)
+                                        return r;
+
+                                r = c_json_doc_open(doc, n_stack++, offset);
+                                if (r)
+                                        return r;
+
+                                break;
+
+                        default:
+                                /* keys and scalars are only validated */
+                                r = c_json_skip(json);
+                                if (r)
+                                        return r;
+
+                                r = c_json_doc_push(doc, offset);
+                                if (r)
+                                        return r;
+
+                                if (n_stack == 0)
+                                        return 0;
+
+                                break;
+                }
+        }
+}
+
+/**
+ * c_json_doc_read() - read the next value into a document
+ * @doc:                document to read into
+ * @json:               reader to read from
+ *
+ * Reads the next value of @json, and everything nested in it, and records
+ * it in @doc, replacing what @doc held before. @json is left behind the
+ * value, as if it had been read with c_json_skip(), and failures poison it
+ * in the same way. The value is then the root of @doc, at index 0.
+ *
+ * @doc points into the input of @json, which must stay valid and
+ * unmodified as long as @doc is used. Input that is fed incrementally
+ * cannot be recorded, and neither can input of 4 GiB or more.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if there is no next value in the current container
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_DEPTH_OVERFLOW if the nesting depth is too high
+ *         -EFBIG if the input is too large
+ */
+_c_public_ int c_json_doc_read(CJsonDoc *doc, CJson *json) {
+        int r;
+
+        assert(json->input && !json->feeding);
+
+        doc->n_tape = 0;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        if ((uint64_t)(json->end - json->input) > UINT32_MAX)
+                return -EFBIG;
+
+        doc->input = json->input;
+        doc->n_input = json->end - json->input;
+
+        if (json->state == '{')
+                return (json->poison = C_JSON_E_INVALID_TYPE);
+
+        r = c_json_doc_record(doc, json);
+        if (r)
+                doc->n_tape = 0;
+
+        return r;
+}
+
+/*
+ * Moves the private reader of @doc to the value at @index.
+ */
+static CJson *c_json_doc_seek(CJsonDoc *doc, size_t index) {
+        size_t offset;
+
+        assert(index < doc->n_tape);
+
+        offset = (uint32_t)doc->tape[index];
+
+        c_json_reset(doc->reader);
+        c_json_begin_read_n(doc->reader, doc->input + offset, doc->n_input - offset);
+
+        return doc->reader;
+}
+
+/**
+ * c_json_doc_type() - get the type of a value
+ * @doc:                document
+ * @index:              index of the value
+ *
+ * Return: one of the C_JSON_TYPE_ values
+ */
+_c_public_ int c_json_doc_type(CJsonDoc *doc, size_t index) {
+        assert(index < doc->n_tape);
+
+        switch (doc->input[(uint32_t)doc->tape[index]]) {
+                case '[':
+                        return C_JSON_TYPE_ARRAY;
+                case '{':
+                        return C_JSON_TYPE_OBJECT;
+                case '"':
+                        return C_JSON_TYPE_STRING;
+                case 't':
+                case 'f':
+                        return C_JSON_TYPE_BOOLEAN;
+                case 'n':
+                        return C_JSON_TYPE_NULL;
+                default:
+                        return C_JSON_TYPE_NUMBER;
+        }
+}
+
+static bool c_json_doc_is_container(CJsonDoc *doc, size_t index) {
+        char c = doc->input[(uint32_t)doc->tape[index]];
+
+        return c == '[' || c == '{';
+}
+
+/**
+ * c_json_doc_next() - get the next sibling of a value
+ * @doc:                document
+ * @index:              index of the value
+ *
+ * Returns the index behind the value and everything nested in it, which
+ * is its next sibling, unless it is the last value of its container.
+ * There, it is the index that c_json_doc_next() returns for the
+ * container itself.
+ *
+ * Return: the index behind the value
+ */
+_c_public_ size_t c_json_doc_next(CJsonDoc *doc, size_t index) {
+        assert(index < doc->n_tape);
+
+        if (c_json_doc_is_container(doc, index))
+                return doc->tape[index] >> 32;
+
+        return index + 1;
+}
+
+/**
+ * c_json_doc_child() - get the first element of a container
+ * @doc:                document
+ * @index:              index of an array or object
+ *
+ * The elements of a container are iterated with c_json_doc_next(), until
+ * it returns the index of c_json_doc_next() of the container. For objects,
+ * keys and values alternate, starting with the first key.
+ *
+ * Return: the index of the first element, which equals the index behind
+ *         the container if it is empty
+ */
+_c_public_ size_t c_json_doc_child(CJsonDoc *doc, size_t index) {
+        assert(index < doc->n_tape && c_json_doc_is_container(doc, index));
+
+        return index + 2;
+}
+
+/**
+ * c_json_doc_length() - get the number of elements of a container
+ * @doc:                document
+ * @index:              index of an array or object
+ *
+ * Return: the number of elements of an array, or members of an object
+ */
+_c_public_ size_t c_json_doc_length(CJsonDoc *doc, size_t index) {
+        assert(index < doc->n_tape && c_json_doc_is_container(doc, index));
+
+        return doc->tape[index + 1];
+}
+
+/**
+ * c_json_doc_find_key() - find a member of an object
+ * @doc:                document
+ * @index:              index of an object
+ * @key:                key to look for
+ * @n_key:              length of @key
+ *
+ * Compares the keys of the object in order, after decoding them.
+ *
+ * Return: the index of the value of the first member with key @key
+ *         C_JSON_KEY_NONE if there is none, or @index is not an object
+ */
+_c_public_ size_t c_json_doc_find_key(CJsonDoc *doc, size_t index, const char *key, size_t n_key) {
+        size_t i, end;
+        const char *k;
+        size_t n;
+
+        if (c_json_doc_type(doc, index) != C_JSON_TYPE_OBJECT)
+                return C_JSON_KEY_NONE;
+
+        end = c_json_doc_next(doc, index);
+        for (i = c_json_doc_child(doc, index); i < end; i = c_json_doc_next(doc, i + 1)) {
+                if (c_json_doc_get_string(doc, i, &k, &n))
+                        return C_JSON_KEY_NONE;
+
+                if (n == n_key && !memcmp(k, key, n))
+                        return i + 1;
+        }
+
+        return C_JSON_KEY_NONE;
+}
+
+/**
+ * c_json_doc_get_string() - get a string
+ * @doc:                document
+ * @index:              index of a string, or of an object key
+ * @stringp:            return location for the string
+ * @np:                 return location for the length of the string
+ *
+ * Like c_json_read_string_view(). The string is only valid until the next
+ * call to any function on @doc.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         C_JSON_E_INVALID_TYPE if the value is not a string
+ */
+_c_public_ int c_json_doc_get_string(CJsonDoc *doc, size_t index, const char **stringp, size_t *np) {
+        return c_json_read_string_view(c_json_doc_seek(doc, index), stringp, np);
+}
+
+/**
+ * c_json_doc_get_u64() - get an unsigned integer
+ * @doc:                document
+ * @index:              index of the value
+ * @numberp:            return location for the integer
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_TYPE if the value is not an unsigned integer
+ *         C_JSON_E_OUT_OF_RANGE if the integer does not fit into 64 bits
+ */
+_c_public_ int c_json_doc_get_u64(CJsonDoc *doc, size_t index, uint64_t *numberp) {
+        return c_json_read_u64(c_json_doc_seek(doc, index), numberp);
+}
+
+/**
+ * c_json_doc_get_i64() - get a signed integer
+ * @doc:                document
+ * @index:              index of the value
+ * @numberp:            return location for the integer
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_TYPE if the value is not an integer
+ *         C_JSON_E_OUT_OF_RANGE if the integer does not fit into 64 bits
+ */
+_c_public_ int c_json_doc_get_i64(CJsonDoc *doc, size_t index, int64_t *numberp) {
+        return c_json_read_i64(c_json_doc_seek(doc, index), numberp);
+}
+
+/**
+ * c_json_doc_get_f64() - get a number
+ * @doc:                document
+ * @index:              index of the value
+ * @numberp:            return location for the number
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_TYPE if the value is not a number
+ */
+_c_public_ int c_json_doc_get_f64(CJsonDoc *doc, size_t index, double *numberp) {
+        return c_json_read_f64(c_json_doc_seek(doc, index), numberp);
+}
+
+/**
+ * c_json_doc_get_bool() - get a boolean
+ * @doc:                document
+ * @index:              index of the value
+ * @boolp:              return location for the boolean
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_TYPE if the value is not a boolean
+ */
+_c_public_ int c_json_doc_get_bool(CJsonDoc *doc, size_t index, bool *boolp) {
+        return c_json_read_bool(c_json_doc_seek(doc, index), boolp);
+}
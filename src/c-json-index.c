@@ -0,0 +1,334 @@
+/*
+ * Structural index
+ *
+ * With C_JSON_FLAG_INDEX, the input is classified up front, 64 bytes at a
+ * time, and the offset of every byte that a reader has to stop at is
+ * recorded: brackets, ':' and ',' outside of strings, the quotes that
+ * delimit strings, and the backslashes and control characters within
+ * them. Readers then jump from one entry to the next instead of scanning
+ * the bytes in between.
+ *
+ * For each block, bitmasks of quotes, backslashes, structural and control
+ * characters are computed with vector comparisons. Escaped characters
+ * follow an odd run of backslashes. The quotes that remain toggle between
+ * string and structure, so the prefix-xor of their mask covers exactly the
+ * strings, from the opening quote up to the closing one. Prefix-xor is a
+ * carry-less multiplication by all ones where available, and a cascade of
+ * shifts otherwise.
+ *
+ * Blocks are aligned, so like the scanners in c-json-scan.c, this reads
+ * bytes in front of and behind the input that share a block with it.
+ * Their bits are discarded.
+ */
+
+#include <c-stdaux.h>
+#include <stdlib.h>
+#include "c-json-private.h"
+
+#define C_JSON_INDEX_BLOCK 64
+
+typedef struct CJsonIndexMasks {
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t structure;
+        uint64_t control;
+} CJsonIndexMasks;
+
+static inline uint64_t c_json_prefix_xor(uint64_t mask) {
+        mask ^= mask << 1;
+        mask ^= mask << 2;
+        mask ^= mask << 4;
+        mask ^= mask << 8;
+        mask ^= mask << 16;
+        mask ^= mask << 32;
+
+        return mask;
+}
+
+/*
+ * Returns the characters that are escaped by a backslash, given the
+ * backslashes of a block. *@carryp holds whether the first character of
+ * the block is escaped, and is updated for the next one. Backslashes are
+ * rare, so they are simply walked in order: each one that is not escaped
+ * itself escapes its successor.
+ */
+static inline uint64_t c_json_index_escaped(uint64_t backslash, uint64_t *carryp) {
+        uint64_t escaped = *carryp, bit;
+
+        *carryp = 0;
+        backslash &= ~escaped;
+
+        while (backslash) {
+                bit = backslash & -backslash;
+                escaped |= bit << 1;
+                *carryp = bit >> 63;
+                backslash &= ~(bit | bit << 1);
+        }
+
+        return escaped;
+}
+
+static int c_json_index_reserve(CJson *json, size_t n) {
+        uint32_t *positions;
+        size_t z;
+
+        if (_c_likely_(json->index.z - json->index.n >= n))
+                return 0;
+
+        z = c_max(json->index.z * 2, json->index.n + n);
+        positions = realloc(json->index.positions, z * sizeof(*positions));
+        if (!positions)
+                return -ENOMEM;
+
+        c_json_stat(json, n_allocations, 1);
+        json->index.positions = positions;
+        json->index.z = z;
+
+        return 0;
+}
+
+/*
+ * Indexes the whole input of @json with @classify, which computes the
+ * masks of one aligned block, and @prefix_xor. Inlined into each kernel,
+ * so that both are inlined in turn.
+ */
+__attribute__((always_inline))
+static inline int c_json_index_run(CJson *json,
+                                   void (*classify)(const char *block, CJsonIndexMasks *masks),
+                                   uint64_t (*prefix_xor)(uint64_t mask)) {
+        const char *input = json->input, *end = json->end;
+        size_t offset = (uintptr_t)input & (C_JSON_INDEX_BLOCK - 1);
+        uint64_t escaped = 0, in_string = 0, valid, quote, bits;
+        const char *block = input - offset;
+        CJsonIndexMasks m;
+        uint32_t *out;
+        int r;
+
+        for (; block < end; block += C_JSON_INDEX_BLOCK, offset = 0) {
+                r = c_json_index_reserve(json, C_JSON_INDEX_BLOCK);
+                if (r)
+                        return r;
+
+                valid = ~UINT64_C(0) << offset;
+                if (end - block < C_JSON_INDEX_BLOCK)
+                        valid &= (UINT64_C(1) << (end - block)) - 1;
+
+                classify(block, &m);
+
+                quote = m.quote & valid & ~c_json_index_escaped(m.backslash & valid, &escaped);
+                bits = prefix_xor(quote) ^ in_string;
+                in_string = (uint64_t)((int64_t)bits >> 63);
+
+                bits = (m.structure & ~bits) | quote | ((m.backslash | m.control) & bits);
+                bits &= valid;
+
+                out = json->index.positions + json->index.n;
+                json->index.n += __builtin_popcountll(bits);
+                while (bits) {
+                        *out++ = (uint32_t)(block - input) + __builtin_ctzll(bits);
+                        bits &= bits - 1;
+                }
+        }
+
+        return 0;
+}
+
+_c_json_no_asan_ static void c_json_classify_scalar(const char *block, CJsonIndexMasks *masks) {
+        CJsonIndexMasks m = {};
+
+        for (size_t i = 0; i < C_JSON_INDEX_BLOCK; i += 1) {
+                char c = block[i];
+
+                m.quote |= (uint64_t)(c == '"') << i;
+                m.backslash |= (uint64_t)(c == '\\') << i;
+                m.structure |= (uint64_t)((c | 0x20) == '{' || (c | 0x20) == '}' || c == ':' || c == ',') << i;
+                m.control |= (uint64_t)((uint8_t)c < 0x20) << i;
+        }
+
+        *masks = m;
+}
+
+static int c_json_index_scalar(CJson *json) {
+        return c_json_index_run(json, c_json_classify_scalar, c_json_prefix_xor);
+}
+
+#if defined(C_JSON_SCAN_SSE2)
+
+_c_json_no_asan_ static inline void c_json_classify_sse2(const char *block, CJsonIndexMasks *masks) {
+        CJsonIndexMasks m = {};
+
+        for (size_t i = 0; i < C_JSON_INDEX_BLOCK; i += 16) {
+                __m128i v = _mm_load_si128((const __m128i *)(block + i));
+                __m128i b = _mm_or_si128(v, _mm_set1_epi8(0x20)), s;
+
+                s = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('{')),
+                                 _mm_cmpeq_epi8(b, _mm_set1_epi8('}')));
+                s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8(':')));
+                s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+
+                m.quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+                m.backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+                m.structure |= (uint64_t)(uint16_t)_mm_movemask_epi8(s) << i;
+                m.control |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v)) << i;
+        }
+
+        *masks = m;
+}
+
+static int c_json_index_sse2(CJson *json) {
+        return c_json_index_run(json, c_json_classify_sse2, c_json_prefix_xor);
+}
+
+#endif
+
+#if defined(C_JSON_SCAN_AVX2)
+
+__attribute__((target("avx2")))
+_c_json_no_asan_ static inline void c_json_classify_avx2(const char *block, CJsonIndexMasks *masks) {
+        CJsonIndexMasks m = {};
+
+        for (size_t i = 0; i < C_JSON_INDEX_BLOCK; i += 32) {
+                __m256i v = _mm256_load_si256((const __m256i *)(block + i));
+                __m256i b = _mm256_or_si256(v, _mm256_set1_epi8(0x20)), s;
+
+                s = _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('{')),
+                                    _mm256_cmpeq_epi8(b, _mm256_set1_epi8('}')));
+                s = _mm256_or_si256(s, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')));
+                s = _mm256_or_si256(s, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')));
+
+                m.quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+                m.backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+                m.structure |= (uint64_t)(uint32_t)_mm256_movemask_epi8(s) << i;
+                m.control |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v)) << i;
+        }
+
+        *masks = m;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("pclmul")))
+static inline uint64_t c_json_prefix_xor_clmul(uint64_t mask) {
+        __m128i v = _mm_set_epi64x(0, (int64_t)mask);
+
+        return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(v, _mm_set1_epi8((char)0xff), 0));
+}
+
+__attribute__((target("avx2,pclmul")))
+static int c_json_index_avx2(CJson *json) {
+        return c_json_index_run(json, c_json_classify_avx2, c_json_prefix_xor_clmul);
+}
+
+#else
+
+__attribute__((target("avx2")))
+static int c_json_index_avx2(CJson *json) {
+        return c_json_index_run(json, c_json_classify_avx2, c_json_prefix_xor);
+}
+
+#endif
+
+#endif
+
+#if defined(C_JSON_SCAN_NEON)
+
+/*
+ * Weighs each byte of four comparison results with its bit position and
+ * adds up neighbours until a single bit per input byte remains.
+ */
+static inline uint64_t c_json_index_bits_neon(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3) {
+        static const uint8_t weights[16] = {
+                0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+        };
+        uint8x16_t w = vld1q_u8(weights), s0, s1;
+
+        s0 = vpaddq_u8(vandq_u8(m0, w), vandq_u8(m1, w));
+        s1 = vpaddq_u8(vandq_u8(m2, w), vandq_u8(m3, w));
+        s0 = vpaddq_u8(s0, s1);
+        s0 = vpaddq_u8(s0, s0);
+
+        return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+_c_json_no_asan_ static inline void c_json_classify_neon(const char *block, CJsonIndexMasks *masks) {
+        uint8x16_t q[4], e[4], s[4], c[4];
+
+        for (size_t i = 0; i < 4; i += 1) {
+                uint8x16_t v = vld1q_u8((const uint8_t *)block + i * 16);
+                uint8x16_t b = vorrq_u8(v, vdupq_n_u8(0x20));
+
+                q[i] = vceqq_u8(v, vdupq_n_u8('"'));
+                e[i] = vceqq_u8(v, vdupq_n_u8('\\'));
+                s[i] = vorrq_u8(vceqq_u8(b, vdupq_n_u8('{')), vceqq_u8(b, vdupq_n_u8('}')));
+                s[i] = vorrq_u8(s[i], vceqq_u8(v, vdupq_n_u8(':')));
+                s[i] = vorrq_u8(s[i], vceqq_u8(v, vdupq_n_u8(',')));
+                c[i] = vcleq_u8(v, vdupq_n_u8(0x1f));
+        }
+
+        masks->quote = c_json_index_bits_neon(q[0], q[1], q[2], q[3]);
+        masks->backslash = c_json_index_bits_neon(e[0], e[1], e[2], e[3]);
+        masks->structure = c_json_index_bits_neon(s[0], s[1], s[2], s[3]);
+        masks->control = c_json_index_bits_neon(c[0], c[1], c[2], c[3]);
+}
+
+static int c_json_index_neon(CJson *json) {
+        return c_json_index_run(json, c_json_classify_neon, c_json_prefix_xor);
+}
+
+#endif
+
+static int c_json_index_resolve(CJson *json);
+
+static int (*c_json_index_fn)(CJson *json) = c_json_index_resolve;
+
+static int c_json_index_resolve(CJson *json) {
+        int (*fn)(CJson *json) = c_json_index_scalar;
+
+#if defined(C_JSON_SCAN_SSE2)
+        fn = c_json_index_sse2;
+#endif
+#if defined(C_JSON_SCAN_AVX2)
+        __builtin_cpu_init();
+#  if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul"))
+                fn = c_json_index_avx2;
+#  else
+        if (__builtin_cpu_supports("avx2"))
+                fn = c_json_index_avx2;
+#  endif
+#endif
+#if defined(C_JSON_SCAN_NEON)
+        fn = c_json_index_neon;
+#endif
+
+        __atomic_store_n(&c_json_index_fn, fn, __ATOMIC_RELAXED);
+
+        return fn(json);
+}
+
+/*
+ * Builds the structural index of the input of @json, see above. Inputs of
+ * 4GiB and more cannot be indexed with 32-bit offsets, and are read
+ * without an index.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ */
+int c_json_index_build(CJson *json) {
+        int r;
+
+        json->index.n = 0;
+        json->index.cursor = 0;
+
+        if ((size_t)(json->end - json->input) >= UINT32_MAX)
+                return 0;
+
+        r = __atomic_load_n(&c_json_index_fn, __ATOMIC_RELAXED)(json);
+        if (r)
+                return r;
+
+        json->indexed = true;
+
+        return 0;
+}
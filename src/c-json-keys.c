@@ -0,0 +1,156 @@
+/*
+ * Key Sets
+ *
+ * A key set maps a fixed list of object keys to their indices. It is
+ * built once as a perfect hash table: the seed is chosen such that no
+ * two keys share a slot, so a lookup costs a single hash and at most one
+ * comparison.
+ */
+
+#include <c-stdaux.h>
+#include <stdlib.h>
+#include "c-json.h"
+#include "c-json-private.h"
+
+typedef struct CJsonKey {
+        const char *key;
+        size_t n_key;
+} CJsonKey;
+
+struct CJsonKeySet {
+        uint64_t seed;
+        size_t mask;
+        size_t n_keys;
+        CJsonKey *keys;
+
+        /* index + 1 of the key in each slot, or 0 if it is empty */
+        uint32_t *slots;
+};
+
+/*
+ * Tries to place all keys with @set->seed.
+ *
+ * Return: 0 on success
+ *         1 if two keys collide
+ *         -EINVAL if @set contains the same key twice
+ */
+static int c_json_key_set_place(CJsonKeySet *set) {
+        memset(set->slots, 0, (set->mask + 1) * sizeof(*set->slots));
+
+        for (size_t i = 0; i < set->n_keys; i += 1) {
+                const CJsonKey *key = &set->keys[i], *other;
+                size_t slot;
+
+                slot = c_json_hash(set->seed, key->key, key->n_key) & set->mask;
+                if (set->slots[slot]) {
+                        other = &set->keys[set->slots[slot] - 1];
+                        if (other->n_key == key->n_key && !memcmp(other->key, key->key, key->n_key))
+                                return -EINVAL;
+
+                        return 1;
+                }
+
+                set->slots[slot] = i + 1;
+        }
+
+        return 0;
+}
+
+/**
+ * c_json_key_set_new() - compile a set of object keys
+ * @setp:               return location
+ * @keys:               keys to match, as 0-terminated UTF-8 strings
+ * @n_keys:             number of keys
+ *
+ * The keys are copied, so @keys does not need to outlive the set. See
+ * c_json_find_keys().
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ *         -EINVAL if a key is given more than once
+ */
+_c_public_ int c_json_key_set_new(CJsonKeySet **setp, const char * const *keys, size_t n_keys) {
+        _c_cleanup_(c_json_key_set_freep) CJsonKeySet *set = NULL;
+        size_t n_slots = 1, n_strings = 0;
+        char *strings;
+        int r;
+
+        if (n_keys >= UINT32_MAX / 2)
+                return -EINVAL;
+
+        /* at most half full, so a seed without collisions is quick to find */
+        while (n_slots < 2 * n_keys)
+                n_slots *= 2;
+
+        for (size_t i = 0; i < n_keys; i += 1)
+                n_strings += strlen(keys[i]);
+
+        for (;;) {
+                set = c_json_key_set_free(set);
+                set = malloc(sizeof(*set) + n_keys * sizeof(*set->keys) + n_slots * sizeof(*set->slots) + n_strings);
+                if (!set)
+                        return -ENOMEM;
+
+                set->mask = n_slots - 1;
+                set->n_keys = n_keys;
+                set->keys = (CJsonKey *)(set + 1);
+                set->slots = (uint32_t *)(set->keys + n_keys);
+
+                strings = (char *)(set->slots + n_slots);
+                for (size_t i = 0; i < n_keys; i += 1) {
+                        set->keys[i].key = strings;
+                        set->keys[i].n_key = strlen(keys[i]);
+                        memcpy(strings, keys[i], set->keys[i].n_key);
+                        strings += set->keys[i].n_key;
+                }
+
+                for (set->seed = 0; set->seed < 64; set->seed += 1) {
+                        r = c_json_key_set_place(set);
+                        if (r <= 0)
+                                break;
+                }
+
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                n_slots *= 2;
+        }
+
+        *setp = set;
+        set = NULL;
+
+        return 0;
+}
+
+/**
+ * c_json_key_set_free() - free a key set
+ * @set:                key set to free, or NULL
+ *
+ * Return: NULL
+ */
+_c_public_ CJsonKeySet * c_json_key_set_free(CJsonKeySet *set) {
+        free(set);
+
+        return NULL;
+}
+
+/*
+ * Returns the index of @key in @set, or C_JSON_KEY_NONE if it is not
+ * part of it.
+ */
+size_t c_json_key_set_lookup(const CJsonKeySet *set, const char *key, size_t n_key) {
+        const CJsonKey *match;
+        uint32_t slot;
+
+        slot = set->slots[c_json_hash(set->seed, key, n_key) & set->mask];
+        if (!slot)
+                return C_JSON_KEY_NONE;
+
+        match = &set->keys[slot - 1];
+        if (match->n_key != n_key || memcmp(match->key, key, n_key))
+                return C_JSON_KEY_NONE;
+
+        return slot - 1;
+}
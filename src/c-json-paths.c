@@ -0,0 +1,557 @@
+/*
+ * Path Queries
+ *
+ * A path set is a list of JSON Pointers (RFC 6901), in which a segment
+ * '*' matches every member of an object or element of an array. The
+ * paths are compiled into a deterministic automaton, with one state for
+ * each combination of path prefixes that a value can be reached by. A
+ * state maps keys to the state of the value behind them with a key set,
+ * and other keys to its fallback, if any of its prefixes continue with a
+ * '*'. Array elements are looked up by their index in decimal.
+ *
+ * While reading, the state of each open container is kept on the stack,
+ * and the reader's own nesting does the rest. Members of an object that
+ * cannot lead to a match are skipped by c_json_find_keys(), without
+ * decoding their keys, so finding a few paths costs about as much as
+ * skipping the document.
+ */
+
+#include <c-stdaux.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-json.h"
+#include "c-json-private.h"
+
+#define C_JSON_PATH_NONE ((size_t)-1)
+
+typedef struct CJsonPathState {
+        /* path that this state completes, or C_JSON_PATH_NONE */
+        size_t accept;
+
+        CJsonKeySet *keys;
+        size_t *targets;
+        size_t fallback;
+        bool numeric : 1;
+} CJsonPathState;
+
+struct CJsonPaths {
+        size_t n_states;
+        CJsonPathState states[];
+};
+
+/*
+ * The paths as a trie, while compiling. Edges without a segment are
+ * wildcards.
+ */
+typedef struct CJsonPathEdge {
+        size_t parent;
+        char *segment;
+        size_t child;
+} CJsonPathEdge;
+
+typedef struct CJsonPathSet {
+        size_t *nodes;
+        size_t n_nodes;
+} CJsonPathSet;
+
+typedef struct CJsonPathCompiler {
+        size_t *accepts;
+        size_t n_nodes;
+
+        CJsonPathEdge *edges;
+        size_t n_edges;
+
+        CJsonPathSet *sets;
+        size_t n_sets;
+        size_t z_sets;
+} CJsonPathCompiler;
+
+static void c_json_path_compiler_deinit(CJsonPathCompiler *c) {
+        for (size_t i = 0; i < c->n_edges; i += 1)
+                free(c->edges[i].segment);
+        for (size_t i = 0; i < c->n_sets; i += 1)
+                free(c->sets[i].nodes);
+        free(c->sets);
+        free(c->edges);
+        free(c->accepts);
+}
+
+/*
+ * Returns the unescaped segment at @p, which ends at the next '/' or the
+ * end of the path, in *@segmentp, or NULL for a wildcard.
+ */
+static int c_json_path_segment(const char *p, const char **endp, char **segmentp) {
+        size_t n = strcspn(p, "/");
+        char *segment, *out;
+
+        if (n == 1 && *p == '*') {
+                *endp = p + 1;
+                *segmentp = NULL;
+                return 0;
+        }
+
+        segment = malloc(n + 1);
+        if (!segment)
+                return -ENOMEM;
+
+        out = segment;
+        for (size_t i = 0; i < n; i += 1) {
+                if (p[i] != '~') {
+                        *out++ = p[i];
+                } else if (i + 1 < n && (p[i + 1] == '0' || p[i + 1] == '1')) {
+                        *out++ = p[i + 1] == '0' ? '~' : '/';
+                        i += 1;
+                } else {
+                        free(segment);
+                        return -EINVAL;
+                }
+        }
+        *out = '\0';
+
+        *endp = p + n;
+        *segmentp = segment;
+
+        return 0;
+}
+
+static int c_json_path_add(CJsonPathCompiler *c, const char *path, size_t index) {
+        const char *p = path;
+        size_t node = 0, i;
+        char *segment;
+        void *grown;
+        int r;
+
+        if (*p && *p != '/')
+                return -EINVAL;
+
+        while (*p) {
+                r = c_json_path_segment(p + 1, &p, &segment);
+                if (r)
+                        return r;
+
+                for (i = 0; i < c->n_edges; i += 1) {
+                        const CJsonPathEdge *edge = &c->edges[i];
+
+                        if (edge->parent == node &&
+                            (edge->segment && segment ? !strcmp(edge->segment, segment) : edge->segment == segment))
+                                break;
+                }
+
+                if (i < c->n_edges) {
+                        free(segment);
+                        node = c->edges[i].child;
+                        continue;
+                }
+
+                grown = realloc(c->edges, (c->n_edges + 1) * sizeof(*c->edges));
+                if (!grown) {
+                        free(segment);
+                        return -ENOMEM;
+                }
+                c->edges = grown;
+
+                grown = realloc(c->accepts, (c->n_nodes + 1) * sizeof(*c->accepts));
+                if (!grown) {
+                        free(segment);
+                        return -ENOMEM;
+                }
+                c->accepts = grown;
+
+                c->accepts[c->n_nodes] = C_JSON_PATH_NONE;
+                c->edges[c->n_edges++] = (CJsonPathEdge){ node, segment, c->n_nodes };
+                node = c->n_nodes++;
+        }
+
+        c->accepts[node] = c_min(c->accepts[node], index);
+
+        return 0;
+}
+
+static int c_json_path_compare(const void *a, const void *b) {
+        size_t x = *(const size_t *)a, y = *(const size_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+/* adds @node to @set, which is kept sorted */
+static int c_json_path_set_add(CJsonPathSet *set, size_t node) {
+        size_t *nodes, i;
+
+        for (i = 0; i < set->n_nodes && set->nodes[i] < node; i += 1)
+                ;
+        if (i < set->n_nodes && set->nodes[i] == node)
+                return 0;
+
+        nodes = realloc(set->nodes, (set->n_nodes + 1) * sizeof(*nodes));
+        if (!nodes)
+                return -ENOMEM;
+
+        memmove(nodes + i + 1, nodes + i, (set->n_nodes - i) * sizeof(*nodes));
+        nodes[i] = node;
+        set->nodes = nodes;
+        set->n_nodes += 1;
+
+        return 0;
+}
+
+/*
+ * Returns the index of the state for @set, which is consumed, in
+ * *@statep, or C_JSON_PATH_NONE if it is empty.
+ */
+static int c_json_path_set_intern(CJsonPathCompiler *c, CJsonPathSet *set, size_t *statep) {
+        CJsonPathSet *sets;
+        size_t z;
+
+        if (set->n_nodes == 0) {
+                *statep = C_JSON_PATH_NONE;
+                return 0;
+        }
+
+        for (size_t i = 0; i < c->n_sets; i += 1) {
+                if (c->sets[i].n_nodes == set->n_nodes &&
+                    !memcmp(c->sets[i].nodes, set->nodes, set->n_nodes * sizeof(*set->nodes))) {
+                        free(set->nodes);
+                        *set = (CJsonPathSet){};
+                        *statep = i;
+                        return 0;
+                }
+        }
+
+        if (c->n_sets >= c->z_sets) {
+                z = c_max(c->z_sets * 2, (size_t)8);
+                sets = realloc(c->sets, z * sizeof(*sets));
+                if (!sets)
+                        return -ENOMEM;
+
+                c->sets = sets;
+                c->z_sets = z;
+        }
+
+        c->sets[c->n_sets] = *set;
+        *set = (CJsonPathSet){};
+        *statep = c->n_sets++;
+
+        return 0;
+}
+
+/* a canonical array index, which no element index formats differently */
+static bool c_json_path_is_index(const char *segment) {
+        size_t n = strspn(segment, "0123456789");
+
+        return n > 0 && n <= 19 && !segment[n] && (n == 1 || segment[0] != '0');
+}
+
+/*
+ * Computes the transitions of the state for @c->sets[@index]. This may
+ * add further sets.
+ */
+static int c_json_path_state(CJsonPathCompiler *c, size_t index, CJsonPathState *state) {
+        _c_cleanup_(c_freep) const char **keys = NULL;
+        CJsonPathSet target = {}, fallback = {};
+        size_t n_keys = 0;
+        const char **grown;
+        int r;
+
+        state->accept = C_JSON_PATH_NONE;
+        state->fallback = C_JSON_PATH_NONE;
+
+        for (size_t i = 0; i < c->sets[index].n_nodes; i += 1)
+                state->accept = c_min(state->accept, c->accepts[c->sets[index].nodes[i]]);
+
+        /* values nested in a match are not looked at */
+        if (state->accept != C_JSON_PATH_NONE)
+                return 0;
+
+        for (size_t i = 0; i < c->n_edges; i += 1) {
+                const CJsonPathEdge *edge = &c->edges[i];
+                size_t j;
+
+                if (!bsearch(&edge->parent, c->sets[index].nodes, c->sets[index].n_nodes,
+                             sizeof(size_t), c_json_path_compare))
+                        continue;
+
+                if (!edge->segment) {
+                        r = c_json_path_set_add(&fallback, edge->child);
+                        if (r)
+                                goto error;
+                        continue;
+                }
+
+                for (j = 0; j < n_keys && strcmp(keys[j], edge->segment); j += 1)
+                        ;
+                if (j < n_keys)
+                        continue;
+
+                grown = realloc(keys, (n_keys + 1) * sizeof(*keys));
+                if (!grown) {
+                        r = -ENOMEM;
+                        goto error;
+                }
+                keys = grown;
+                keys[n_keys++] = edge->segment;
+                state->numeric = state->numeric || c_json_path_is_index(edge->segment);
+        }
+
+        if (n_keys > 0) {
+                r = c_json_key_set_new(&state->keys, keys, n_keys);
+                if (r)
+                        goto error;
+
+                state->targets = calloc(n_keys, sizeof(*state->targets));
+                if (!state->targets) {
+                        r = -ENOMEM;
+                        goto error;
+                }
+        }
+
+        /* a key leads to where it leads in any of the prefixes, or any wildcard */
+        for (size_t k = 0; k < n_keys; k += 1) {
+                for (size_t i = 0; i < c->n_edges; i += 1) {
+                        const CJsonPathEdge *edge = &c->edges[i];
+
+                        if (!bsearch(&edge->parent, c->sets[index].nodes, c->sets[index].n_nodes,
+                                     sizeof(size_t), c_json_path_compare))
+                                continue;
+
+                        if (!edge->segment || !strcmp(edge->segment, keys[k])) {
+                                r = c_json_path_set_add(&target, edge->child);
+                                if (r)
+                                        goto error;
+                        }
+                }
+
+                r = c_json_path_set_intern(c, &target, &state->targets[k]);
+                if (r)
+                        goto error;
+        }
+
+        r = c_json_path_set_intern(c, &fallback, &state->fallback);
+        if (r)
+                goto error;
+
+        return 0;
+
+error:
+        free(target.nodes);
+        free(fallback.nodes);
+        return r;
+}
+
+/**
+ * c_json_paths_new() - compile a set of paths
+ * @pathsp:             return location
+ * @paths:              paths to match, as 0-terminated JSON Pointers
+ * @n_paths:            number of paths
+ *
+ * Each path is a JSON Pointer, such as "/user/id", where "" is the value
+ * itself. A segment "*" matches all members of an object, or elements of
+ * an array, so it cannot match a key "*" alone. Segments that are decimal
+ * numbers also match the array element with that index, as in a JSON
+ * Pointer. Keys are compared as they appear in the input, like
+ * c_json_find_keys() does. See c_json_find_paths().
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ *         -EINVAL if a path is not a valid JSON Pointer
+ */
+_c_public_ int c_json_paths_new(CJsonPaths **pathsp, const char * const *paths, size_t n_paths) {
+        _c_cleanup_(c_json_paths_freep) CJsonPaths *compiled = NULL;
+        CJsonPathCompiler c = {};
+        CJsonPathSet root = {};
+        CJsonPathState *states = NULL;
+        size_t n_states = 0, state;
+        void *grown;
+        int r;
+
+        c.accepts = malloc(sizeof(*c.accepts));
+        if (!c.accepts)
+                return -ENOMEM;
+        c.accepts[0] = C_JSON_PATH_NONE;
+        c.n_nodes = 1;
+
+        for (size_t i = 0; i < n_paths; i += 1) {
+                r = c_json_path_add(&c, paths[i], i);
+                if (r)
+                        goto out;
+        }
+
+        r = c_json_path_set_add(&root, 0);
+        if (r)
+                goto out;
+
+        r = c_json_path_set_intern(&c, &root, &state);
+        if (r) {
+                free(root.nodes);
+                goto out;
+        }
+
+        /* each state may add further sets, which are computed in turn */
+        for (; n_states < c.n_sets; n_states += 1) {
+                grown = realloc(states, (n_states + 1) * sizeof(*states));
+                if (!grown) {
+                        r = -ENOMEM;
+                        goto out;
+                }
+                states = grown;
+                states[n_states] = (CJsonPathState){};
+
+                r = c_json_path_state(&c, n_states, &states[n_states]);
+                if (r) {
+                        n_states += 1;
+                        goto out;
+                }
+        }
+
+        compiled = malloc(sizeof(*compiled) + n_states * sizeof(*states));
+        if (!compiled) {
+                r = -ENOMEM;
+                goto out;
+        }
+
+        compiled->n_states = n_states;
+        memcpy(compiled->states, states, n_states * sizeof(*states));
+        n_states = 0;
+
+        *pathsp = compiled;
+        compiled = NULL;
+
+out:
+        for (size_t i = 0; i < n_states; i += 1) {
+                c_json_key_set_free(states[i].keys);
+                free(states[i].targets);
+        }
+        free(states);
+        c_json_path_compiler_deinit(&c);
+        return r;
+}
+
+/**
+ * c_json_paths_free() - free a set of paths
+ * @paths:              paths to free, or NULL
+ *
+ * Return: NULL
+ */
+_c_public_ CJsonPaths * c_json_paths_free(CJsonPaths *paths) {
+        if (!paths)
+                return NULL;
+
+        for (size_t i = 0; i < paths->n_states; i += 1) {
+                c_json_key_set_free(paths->states[i].keys);
+                free(paths->states[i].targets);
+        }
+        free(paths);
+
+        return NULL;
+}
+
+typedef struct CJsonPathVisit {
+        const CJsonPaths *paths;
+        CJsonPathFn fn;
+        void *userdata;
+} CJsonPathVisit;
+
+static int c_json_path_visit(CJson *json, const CJsonPathVisit *visit, size_t index) {
+        const CJsonPathState *state;
+        const char *key;
+        size_t n_key, k, i;
+        char buffer[C_DECIMAL_MAX(size_t)];
+        int r;
+
+        if (index == C_JSON_PATH_NONE)
+                return c_json_skip(json);
+
+        state = &visit->paths->states[index];
+        if (state->accept != C_JSON_PATH_NONE)
+                return visit->fn(visit->userdata, json, state->accept);
+
+        if (!state->keys && state->fallback == C_JSON_PATH_NONE)
+                return c_json_skip(json);
+
+        switch (c_json_peek(json)) {
+                case C_JSON_TYPE_OBJECT:
+                        r = c_json_open_object(json);
+                        if (r)
+                                return r;
+
+                        if (state->fallback == C_JSON_PATH_NONE) {
+                                for (;;) {
+                                        r = c_json_find_keys(json, state->keys, &k);
+                                        if (r)
+                                                return r;
+                                        if (k == C_JSON_KEY_NONE)
+                                                break;
+
+                                        r = c_json_path_visit(json, visit, state->targets[k]);
+                                        if (r)
+                                                return r;
+                                }
+                        } else {
+                                while (c_json_more(json)) {
+                                        r = c_json_read_string_view(json, &key, &n_key);
+                                        if (r)
+                                                return r;
+
+                                        k = state->keys ? c_json_key_set_lookup(state->keys, key, n_key) : C_JSON_KEY_NONE;
+                                        r = c_json_path_visit(json, visit, k == C_JSON_KEY_NONE ? state->fallback : state->targets[k]);
+                                        if (r)
+                                                return r;
+                                }
+                        }
+
+                        return c_json_close_object(json);
+
+                case C_JSON_TYPE_ARRAY:
+                        r = c_json_open_array(json);
+                        if (r)
+                                return r;
+
+                        for (i = 0; c_json_more(json); i += 1) {
+                                k = C_JSON_KEY_NONE;
+                                if (state->numeric)
+                                        k = c_json_key_set_lookup(state->keys, buffer,
+                                                                  snprintf(buffer, sizeof(buffer), "%zu", i));
+
+                                r = c_json_path_visit(json, visit, k == C_JSON_KEY_NONE ? state->fallback : state->targets[k]);
+                                if (r)
+                                        return r;
+                        }
+
+                        return c_json_close_array(json);
+
+                default:
+                        return c_json_skip(json);
+        }
+}
+
+/**
+ * c_json_find_paths() - read the values at a set of paths
+ * @json                json object
+ * @paths               paths to look for
+ * @fn                  callback to read a matching value
+ * @userdata            argument passed to @fn
+ *
+ * Reads the next value, and calls @fn for each value within it that one of
+ * @paths points to, in the order they appear in the input. @fn is called
+ * with the index of the path and @json in front of the value, and must
+ * read or skip exactly that value. Everything else is skipped. If a value
+ * matches several paths, @fn is called once, for the first of them, and
+ * paths that point into a value that matched are not looked at.
+ *
+ * This does not support input that is fed incrementally.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the first non-zero value returned by @fn
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if there is no next value in the current container
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_DEPTH_OVERFLOW if the nesting depth is too high
+ */
+_c_public_ int c_json_find_paths(CJson *json, const CJsonPaths *paths, CJsonPathFn fn, void *userdata) {
+        CJsonPathVisit visit = { paths, fn, userdata };
+
+        assert(!json->feeding);
+
+        return c_json_path_visit(json, &visit, 0);
+}
@@ -0,0 +1,111 @@
+/*
+ * Reader Pools
+ *
+ * A pool keeps readers that are no longer in use, so handing out the
+ * next one does not need to allocate. Pools are not thread-safe, they are
+ * meant to be kept per thread.
+ */
+
+#include <c-stdaux.h>
+#include <stdlib.h>
+#include "c-json.h"
+
+struct CJsonPool {
+        size_t max_depth;
+        size_t n_json;
+        size_t z_json;
+        CJson *json[];
+};
+
+/**
+ * c_json_pool_new() - allocate a pool of readers
+ * @poolp:              return location
+ * @max_depth:          maximum nesting depth of the readers handed out
+ * @n_max:              maximum number of idle readers kept by the pool
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ */
+_c_public_ int c_json_pool_new(CJsonPool **poolp, size_t max_depth, size_t n_max) {
+        CJsonPool *pool;
+
+        pool = calloc(1, sizeof(*pool) + n_max * sizeof(*pool->json));
+        if (!pool)
+                return -ENOMEM;
+
+        pool->max_depth = max_depth;
+        pool->z_json = n_max;
+
+        *poolp = pool;
+
+        return 0;
+}
+
+/**
+ * c_json_pool_free() - free a pool and its idle readers
+ * @pool:               pool to free, or NULL
+ *
+ * Readers that are still in use are not affected, and must be freed with
+ * c_json_free() instead of being returned to the pool.
+ *
+ * Return: NULL
+ */
+_c_public_ CJsonPool * c_json_pool_free(CJsonPool *pool) {
+        if (!pool)
+                return NULL;
+
+        for (size_t i = 0; i < pool->n_json; i += 1)
+                c_json_free(pool->json[i]);
+
+        free(pool);
+
+        return NULL;
+}
+
+/**
+ * c_json_pool_get() - take a reader from a pool
+ * @pool:               pool to take from
+ * @jsonp:              return location
+ *
+ * Hands out an idle reader, or allocates a new one if there is none. In
+ * both cases, the reader is in the same state as one that was just
+ * created by c_json_new().
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ */
+_c_public_ int c_json_pool_get(CJsonPool *pool, CJson **jsonp) {
+        if (!pool->n_json)
+                return c_json_new(jsonp, pool->max_depth);
+
+        *jsonp = pool->json[--pool->n_json];
+
+        return 0;
+}
+
+/**
+ * c_json_pool_put() - return a reader to a pool
+ * @pool:               pool to return to
+ * @json:               reader taken from @pool, or NULL
+ *
+ * The reader may be in any state. Before it is kept, it is reset, and
+ * its flags, arena and symbol table are cleared. If the pool is full, it
+ * is freed.
+ *
+ * Return: NULL
+ */
+_c_public_ CJson * c_json_pool_put(CJsonPool *pool, CJson *json) {
+        if (!json)
+                return NULL;
+
+        if (pool->n_json >= pool->z_json)
+                return c_json_free(json);
+
+        c_json_reset(json);
+        c_json_set_flags(json, 0);
+        c_json_set_arena(json, NULL, 0, NULL, NULL);
+        c_json_set_symbols(json, NULL);
+        pool->json[pool->n_json++] = json;
+
+        return NULL;
+}
@@ -0,0 +1,450 @@
+#pragma once
+
+/*
+ * Private definitions shared between the translation units of the
+ * library. Nothing in here is part of the API.
+ */
+
+#include <c-stdaux.h>
+#include <locale.h>
+#include <time.h>
+#include "c-json.h"
+
+/*
+ * The vector kernels load whole, aligned blocks. An aligned block never
+ * crosses a page boundary, so reading the bytes that follow the end of
+ * the input within the same block cannot fault. No block that starts at
+ * or behind the end is loaded, and matches behind it are discarded.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  if defined(__SSE2__)
+#    define C_JSON_SCAN_SSE2 1
+#  endif
+#  if defined(__GNUC__)
+#    define C_JSON_SCAN_AVX2 1
+#  endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define C_JSON_SCAN_NEON 1
+#endif
+
+#if defined(__has_attribute)
+#  if __has_attribute(no_sanitize_address)
+#    define _c_json_no_asan_ __attribute__((no_sanitize_address))
+#  endif
+#endif
+#ifndef _c_json_no_asan_
+#  define _c_json_no_asan_
+#endif
+
+/*
+ * Returns the byte at @p, or 0 if @p is at @end. A 0-byte is not valid
+ * anywhere in JSON, so readers fail on an embedded one just like they
+ * fail on a premature end.
+ */
+static inline char c_json_char(const char *p, const char *end) {
+        return _c_likely_(p < end) ? *p : '\0';
+}
+
+/*
+ * Returns a pointer to the first byte in [@p, @end) that cannot be
+ * copied verbatim out of a JSON string: '"', '\\' or a control
+ * character below 0x20, or @end if there is none.
+ */
+const char *c_json_skip_string_chars(const char *p, const char *end);
+
+/*
+ * Like c_json_skip_string_chars(), but also stops at bytes of 0x80 and
+ * above, so runs of ASCII are skipped at full speed and only the
+ * sequences that follow need to be validated.
+ */
+const char *c_json_skip_string_chars_utf8(const char *p, const char *end);
+
+/*
+ * Returns the length of the well-formed UTF-8 sequence of two to four
+ * bytes at @p, which must be before @end, 0 if there is none, or SIZE_MAX
+ * if @end cuts off what would otherwise be one.
+ */
+size_t c_json_utf8_sequence(const char *p, const char *end);
+
+/*
+ * Returns a pointer to the first '"', '[', ']', '{' or '}' in [@p, @end),
+ * or @end if there is none.
+ */
+const char *c_json_skip_structure_chars(const char *p, const char *end);
+
+#if defined(C_JSON_SCAN_SSE2)
+
+_c_json_no_asan_ static inline const char *c_json_skip_space_chars_sse2(const char *p, const char *end) {
+        size_t offset = (uintptr_t)p & 15;
+        const char *block = p - offset;
+        unsigned int mask;
+        __m128i v, m;
+
+        while (block < end) {
+                v = _mm_load_si128((const __m128i *)block);
+                m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+                m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+                m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+
+                mask = ~(unsigned int)_mm_movemask_epi8(m) & 0xffff;
+                mask = mask >> offset << offset;
+                if (mask)
+                        return c_min(block + __builtin_ctz(mask), end);
+
+                block += 16;
+                offset = 0;
+        }
+
+        return end;
+}
+
+#elif defined(C_JSON_SCAN_NEON)
+
+_c_json_no_asan_ static inline const char *c_json_skip_space_chars_neon(const char *p, const char *end) {
+        size_t offset = (uintptr_t)p & 15;
+        const char *block = p - offset;
+        uint8x16_t v, m;
+        uint64_t mask;
+
+        while (block < end) {
+                v = vld1q_u8((const uint8_t *)block);
+                m = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\n')));
+                m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\t')));
+                m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\r')));
+
+                mask = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+                mask = mask >> (offset * 4) << (offset * 4);
+                if (mask)
+                        return c_min(block + __builtin_ctzll(mask) / 4, end);
+
+                block += 16;
+                offset = 0;
+        }
+
+        return end;
+}
+
+#else
+
+/*
+ * Returns a word with the high bit set in every byte of @word that
+ * equals @c, without the false positives of the carry based variant.
+ */
+static inline uint64_t c_json_swar_eq(uint64_t word, char c) {
+        uint64_t t = word ^ (0x0101010101010101ULL * (uint8_t)c);
+
+        return ~(((t & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | t | 0x7f7f7f7f7f7f7f7fULL);
+}
+
+_c_json_no_asan_ static inline const char *c_json_skip_space_chars_swar(const char *p, const char *end) {
+        size_t offset = (uintptr_t)p & 7;
+        const char *block = p - offset;
+        uint64_t word, mask;
+
+        while (block < end) {
+                memcpy(&word, block, sizeof(word));
+                mask = c_json_swar_eq(word, ' ') | c_json_swar_eq(word, '\n') |
+                       c_json_swar_eq(word, '\t') | c_json_swar_eq(word, '\r');
+                mask = ~mask & 0x8080808080808080ULL;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                mask = mask >> (offset * 8) << (offset * 8);
+                if (mask)
+                        return c_min(block + __builtin_ctzll(mask) / 8, end);
+#else
+                mask = mask << (offset * 8) >> (offset * 8);
+                if (mask)
+                        return c_min(block + __builtin_clzll(mask) / 8, end);
+#endif
+
+                block += 8;
+                offset = 0;
+        }
+
+        return end;
+}
+
+#endif
+
+/*
+ * Counters are only kept if the library was built with the stats option,
+ * and compile to nothing otherwise. Their arguments are still evaluated,
+ * so they must not have side effects.
+ */
+#if defined(C_JSON_STATS) && C_JSON_STATS
+#  define c_json_stat(_json, _field, _n) ((_json)->stats._field += (_n))
+#  define c_json_stat_max(_json, _field, _n) \
+        ((_json)->stats._field = c_max((_json)->stats._field, (uint64_t)(_n)))
+#else
+#  define c_json_stat(_json, _field, _n) ((void)(_n))
+#  define c_json_stat_max(_json, _field, _n) ((void)(_n))
+#endif
+
+/*
+ * Returns a timestamp in nanoseconds for the ns_* counters, or 0 if
+ * counters are not kept.
+ */
+static inline uint64_t c_json_stat_now(void) {
+#if defined(C_JSON_STATS) && C_JSON_STATS
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+        return 0;
+#endif
+}
+
+struct CJson {
+        const char *input;
+
+        /*
+         * Current position in the input. Always points to the start of
+         * the next value.
+         */
+        const char *p;
+
+        /*
+         * End of the input. The input is not necessarily 0-terminated,
+         * so nothing at or behind @end may be read.
+         */
+        const char *end;
+
+        /*
+         * Last error code. If it is non-zero, every function turns into
+         * a no-op and returns this value.
+         */
+        int poison;
+
+        /* C_JSON_FLAG_* */
+        unsigned int flags;
+
+        /*
+         * Optional arena that c_json_read_string() allocates from, see
+         * c_json_set_arena(). @p and @n describe the free part of the
+         * current block, which is rewound to @buffer once reading ends.
+         * Blocks returned by @grow belong to the caller.
+         */
+        struct {
+                char *buffer;
+                size_t n_buffer;
+                char *p;
+                size_t n;
+                CJsonArenaGrowFn grow;
+                void *userdata;
+        } arena;
+
+        /*
+         * State of the current nesting level. @n_states is the maximum
+         * nesting depth. The state can be:
+         *
+         *  0: root level
+         *
+         *  '[': in an array and @p points to the next value or ']'
+         *  ',': in an array and @p is behind a ','
+         *
+         *  '{': in an object and @p points to the next key
+         *  ':': in an object and @p points to the next value
+         *  '}': in an object and @p points to the '}' behind the last value
+         *
+         * The levels below the current one are all in front of a value,
+         * so they only need to remember whether they are an array or an
+         * object. That takes a bit per level in @kinds, and the state is
+         * restored from it when the current level is closed, see
+         * c_json_pop().
+         */
+        size_t n_states;
+        size_t level;
+        char state;
+
+        /*
+         * The last value at the root level was a scalar, and nothing
+         * separates it from what follows, see c_json_next_document().
+         */
+        bool adjacent : 1;
+
+        /*
+         * Decoding buffer for strings that contain escape sequences.
+         * Reused for every string, so it is only valid until the next
+         * call.
+         */
+        char *buffer;
+        size_t n_buffer;
+
+        /* intern table of c_json_read_key(), see c_json_set_symbols() */
+        CJsonSymbols *symbols;
+
+        /* the input is writable, see c_json_begin_read_inplace() */
+        bool inplace : 1;
+
+        /*
+         * Mapping of the file that is read, see c_json_begin_read_file().
+         * It is unmapped once reading ends.
+         */
+        struct {
+                void *p;
+                size_t n;
+        } map;
+
+        /*
+         * Structural index of the input, see c-json-index.c. Holds the
+         * offsets of @n entries in ascending order, and @cursor is the
+         * first one that may still be at or behind @p.
+         */
+        struct {
+                uint32_t *positions;
+                size_t n;
+                size_t z;
+                size_t cursor;
+        } index;
+        bool indexed : 1;
+
+        /*
+         * Output, see c_json_begin_write(). @out holds @n_out bytes that
+         * have not been flushed yet. Without a @flush callback, it grows
+         * to hold the whole document.
+         *
+         * Writers use the nesting state as well, with these meanings:
+         *
+         *  0: root level, nothing written yet
+         *
+         *  '[': in an array, nothing written yet
+         *  ']': in an array, behind a value
+         *
+         *  '{': in an object, nothing written yet
+         *  '}': in an object, behind a value
+         *  ':': in an object, behind a key
+         *
+         * At the root level, ']' marks that the document is complete.
+         */
+        char *out;
+        size_t n_out;
+        size_t z_out;
+        CJsonFlushFn flush;
+        void *userdata;
+        bool writing : 1;
+
+        /*
+         * Incremental input, see c_json_feed(). @feed holds @n_feed
+         * bytes that have not been consumed yet, and @end points behind
+         * them. @final is set once the caller signalled the end of the
+         * input.
+         *
+         * Every reader saves its starting position in @mark. If it runs
+         * into @end before the input is final, it rolls back to @mark
+         * and returns C_JSON_E_AGAIN, so it can be called again with
+         * more input. Readers leave @p at the offending byte when they
+         * fail, which tells this apart from actual errors.
+         */
+        char *feed;
+        size_t n_feed;
+        size_t z_feed;
+        bool feeding : 1;
+        bool final : 1;
+        struct {
+                const char *p;
+                size_t level;
+                char state;
+        } mark;
+
+#if defined(C_JSON_STATS) && C_JSON_STATS
+        /*
+         * Counters of the current or last read, see c_json_get_stats().
+         * @n_bytes does not include the input in front of @input yet.
+         */
+        CJsonStats stats;
+#endif
+
+        /* bit n is set if level n is an object */
+        uint8_t kinds[];
+};
+
+/*
+ * Enters a new nesting level in @state, which is '{' for objects and
+ * anything else for arrays.
+ */
+static inline void c_json_push(CJson *json, char state) {
+        uint8_t bit = 1 << (++json->level % 8);
+
+        if (state == '{')
+                json->kinds[json->level / 8] |= bit;
+        else
+                json->kinds[json->level / 8] &= ~bit;
+
+        json->state = state;
+}
+
+/*
+ * Leaves the current nesting level. The level below was in front of the
+ * value that was just closed, which readers and writers both track as
+ * '[' in arrays and ':' in objects.
+ */
+static inline void c_json_pop(CJson *json) {
+        bool object;
+
+        json->level -= 1;
+        object = json->kinds[json->level / 8] >> (json->level % 8) & 1;
+        json->state = json->level ? (object ? ':' : '[') : 0;
+}
+
+/*
+ * A number as written in the input: @mantissa * 10^@exponent, where
+ * @mantissa holds at most 19 significant digits.
+ */
+typedef struct CJsonNumber {
+        const char *end;
+        uint64_t mantissa;
+        int64_t exponent;
+        bool negative : 1;
+        bool integer : 1;
+        bool truncated : 1;
+} CJsonNumber;
+
+int c_json_parse_number(const char *p, const char *end, CJsonNumber *numberp);
+int c_json_skip_number(const char *p, const char *end, const char **endp);
+int c_json_parse_integer(const char *p, const char *end, bool *negativep, uint64_t *magnitudep, const char **endp);
+int c_json_number_to_f64(const CJsonNumber *number, const char *start, double *f64p);
+locale_t c_json_c_locale(void);
+
+#define C_JSON_F64_MAX 32
+
+size_t c_json_format_f64(double f64, char *buffer);
+
+void c_json_stop_write(CJson *json);
+
+int c_json_index_build(CJson *json);
+
+/* FNV-1a, with the seed folded into the offset basis */
+static inline uint64_t c_json_hash(uint64_t seed, const char *key, size_t n_key) {
+        uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+
+        for (size_t i = 0; i < n_key; i += 1) {
+                hash ^= (uint8_t)key[i];
+                hash *= 0x100000001b3ULL;
+        }
+
+        return hash ^ (hash >> 32);
+}
+
+size_t c_json_key_set_lookup(const CJsonKeySet *set, const char *key, size_t n_key);
+
+int c_json_symbols_intern(CJsonSymbols *symbols, const char *key, size_t n_key, size_t *idp);
+
+/*
+ * Returns a pointer to the first byte in [@p, @end) that is not JSON
+ * whitespace, or @end if there is none. This is inlined, as the runs it
+ * skips are usually short.
+ */
+static inline const char *c_json_skip_space_chars(const char *p, const char *end) {
+#if defined(C_JSON_SCAN_SSE2)
+        return c_json_skip_space_chars_sse2(p, end);
+#elif defined(C_JSON_SCAN_NEON)
+        return c_json_skip_space_chars_neon(p, end);
+#else
+        return c_json_skip_space_chars_swar(p, end);
+#endif
+}
@@ -0,0 +1,377 @@
+/*
+ * Vectorized string and structure scanning
+ *
+ * See c-json-private.h for why the aligned overreads are safe.
+ */
+
+#include <c-stdaux.h>
+#include "c-json-private.h"
+
+static const char *c_json_skip_string_chars_scalar(const char *p, const char *end) {
+        while (p < end && *p != '"' && *p != '\\' && (uint8_t)*p >= 0x20)
+                p += 1;
+
+        return p;
+}
+
+static const char *c_json_skip_string_chars_utf8_scalar(const char *p, const char *end) {
+        while (p < end && *p != '"' && *p != '\\' && (uint8_t)*p >= 0x20 && (uint8_t)*p < 0x80)
+                p += 1;
+
+        return p;
+}
+
+/*
+ * '[' and '{' as well as ']' and '}' only differ in bit 0x20, so setting
+ * it lets a single comparison match both brackets of a kind.
+ */
+static const char *c_json_skip_structure_chars_scalar(const char *p, const char *end) {
+        while (p < end && *p != '"' && (*p | 0x20) != '{' && (*p | 0x20) != '}')
+                p += 1;
+
+        return p;
+}
+
+#if defined(C_JSON_SCAN_SSE2)
+
+/* with @utf8, bytes with the high bit set match as well, which is their sign */
+static inline unsigned int c_json_string_mask_sse2(__m128i v, bool utf8) {
+        __m128i m;
+
+        m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v));
+        if (utf8)
+                m = _mm_or_si128(m, v);
+
+        return (unsigned int)_mm_movemask_epi8(m);
+}
+
+_c_json_no_asan_ static inline const char *c_json_scan_string_sse2(const char *p, const char *end, bool utf8) {
+        size_t offset = (uintptr_t)p & 15;
+        const char *block = p - offset;
+        unsigned int mask;
+
+        if (block >= end)
+                return end;
+
+        mask = c_json_string_mask_sse2(_mm_load_si128((const __m128i *)block), utf8) >> offset << offset;
+        while (!mask) {
+                block += 16;
+                if (block >= end)
+                        return end;
+                mask = c_json_string_mask_sse2(_mm_load_si128((const __m128i *)block), utf8);
+        }
+
+        return c_min(block + __builtin_ctz(mask), end);
+}
+
+_c_json_no_asan_ static const char *c_json_skip_string_chars_sse2(const char *p, const char *end) {
+        return c_json_scan_string_sse2(p, end, false);
+}
+
+_c_json_no_asan_ static const char *c_json_skip_string_chars_utf8_sse2(const char *p, const char *end) {
+        return c_json_scan_string_sse2(p, end, true);
+}
+
+static inline unsigned int c_json_structure_mask_sse2(__m128i v) {
+        __m128i m, b = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+        m = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('{')),
+                         _mm_cmpeq_epi8(b, _mm_set1_epi8('}')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+
+        return (unsigned int)_mm_movemask_epi8(m);
+}
+
+_c_json_no_asan_ static const char *c_json_skip_structure_chars_sse2(const char *p, const char *end) {
+        size_t offset = (uintptr_t)p & 15;
+        const char *block = p - offset;
+        unsigned int mask;
+
+        if (block >= end)
+                return end;
+
+        mask = c_json_structure_mask_sse2(_mm_load_si128((const __m128i *)block)) >> offset << offset;
+        while (!mask) {
+                block += 16;
+                if (block >= end)
+                        return end;
+                mask = c_json_structure_mask_sse2(_mm_load_si128((const __m128i *)block));
+        }
+
+        return c_min(block + __builtin_ctz(mask), end);
+}
+
+#endif
+
+#if defined(C_JSON_SCAN_AVX2)
+
+__attribute__((target("avx2")))
+static inline uint32_t c_json_string_mask_avx2(__m256i v, bool utf8) {
+        __m256i m;
+
+        m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v));
+        if (utf8)
+                m = _mm256_or_si256(m, v);
+
+        return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+_c_json_no_asan_ static inline const char *c_json_scan_string_avx2(const char *p, const char *end, bool utf8) {
+        size_t offset = (uintptr_t)p & 31;
+        const char *block = p - offset;
+        uint32_t mask;
+
+        if (block >= end)
+                return end;
+
+        mask = c_json_string_mask_avx2(_mm256_load_si256((const __m256i *)block), utf8) >> offset << offset;
+        while (!mask) {
+                block += 32;
+                if (block >= end)
+                        return end;
+                mask = c_json_string_mask_avx2(_mm256_load_si256((const __m256i *)block), utf8);
+        }
+
+        return c_min(block + __builtin_ctz(mask), end);
+}
+
+__attribute__((target("avx2")))
+_c_json_no_asan_ static const char *c_json_skip_string_chars_avx2(const char *p, const char *end) {
+        return c_json_scan_string_avx2(p, end, false);
+}
+
+__attribute__((target("avx2")))
+_c_json_no_asan_ static const char *c_json_skip_string_chars_utf8_avx2(const char *p, const char *end) {
+        return c_json_scan_string_avx2(p, end, true);
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t c_json_structure_mask_avx2(__m256i v) {
+        __m256i m, b = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+
+        m = _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('{')),
+                            _mm256_cmpeq_epi8(b, _mm256_set1_epi8('}')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+
+        return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+_c_json_no_asan_ static const char *c_json_skip_structure_chars_avx2(const char *p, const char *end) {
+        size_t offset = (uintptr_t)p & 31;
+        const char *block = p - offset;
+        uint32_t mask;
+
+        if (block >= end)
+                return end;
+
+        mask = c_json_structure_mask_avx2(_mm256_load_si256((const __m256i *)block)) >> offset << offset;
+        while (!mask) {
+                block += 32;
+                if (block >= end)
+                        return end;
+                mask = c_json_structure_mask_avx2(_mm256_load_si256((const __m256i *)block));
+        }
+
+        return c_min(block + __builtin_ctz(mask), end);
+}
+
+#endif
+
+#if defined(C_JSON_SCAN_NEON)
+
+/*
+ * NEON has no movemask. Narrowing the comparison result by four bits
+ * per lane yields a 64-bit mask with one nibble per input byte.
+ */
+static inline uint64_t c_json_string_mask_neon(uint8x16_t v, bool utf8) {
+        uint8x16_t m;
+
+        m = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+        m = vorrq_u8(m, vcleq_u8(v, vdupq_n_u8(0x1f)));
+        if (utf8)
+                m = vorrq_u8(m, vcgeq_u8(v, vdupq_n_u8(0x80)));
+
+        return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+_c_json_no_asan_ static inline const char *c_json_scan_string_neon(const char *p, const char *end, bool utf8) {
+        size_t offset = (uintptr_t)p & 15;
+        const char *block = p - offset;
+        uint64_t mask;
+
+        if (block >= end)
+                return end;
+
+        mask = c_json_string_mask_neon(vld1q_u8((const uint8_t *)block), utf8) >> (offset * 4) << (offset * 4);
+        while (!mask) {
+                block += 16;
+                if (block >= end)
+                        return end;
+                mask = c_json_string_mask_neon(vld1q_u8((const uint8_t *)block), utf8);
+        }
+
+        return c_min(block + __builtin_ctzll(mask) / 4, end);
+}
+
+_c_json_no_asan_ static const char *c_json_skip_string_chars_neon(const char *p, const char *end) {
+        return c_json_scan_string_neon(p, end, false);
+}
+
+_c_json_no_asan_ static const char *c_json_skip_string_chars_utf8_neon(const char *p, const char *end) {
+        return c_json_scan_string_neon(p, end, true);
+}
+
+static inline uint64_t c_json_structure_mask_neon(uint8x16_t v) {
+        uint8x16_t m, b = vorrq_u8(v, vdupq_n_u8(0x20));
+
+        m = vorrq_u8(vceqq_u8(b, vdupq_n_u8('{')), vceqq_u8(b, vdupq_n_u8('}')));
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('"')));
+
+        return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+_c_json_no_asan_ static const char *c_json_skip_structure_chars_neon(const char *p, const char *end) {
+        size_t offset = (uintptr_t)p & 15;
+        const char *block = p - offset;
+        uint64_t mask;
+
+        if (block >= end)
+                return end;
+
+        mask = c_json_structure_mask_neon(vld1q_u8((const uint8_t *)block)) >> (offset * 4) << (offset * 4);
+        while (!mask) {
+                block += 16;
+                if (block >= end)
+                        return end;
+                mask = c_json_structure_mask_neon(vld1q_u8((const uint8_t *)block));
+        }
+
+        return c_min(block + __builtin_ctzll(mask) / 4, end);
+}
+
+#endif
+
+static const char *c_json_skip_string_chars_resolve(const char *p, const char *end);
+static const char *c_json_skip_string_chars_utf8_resolve(const char *p, const char *end);
+static const char *c_json_skip_structure_chars_resolve(const char *p, const char *end);
+
+static const char *(*c_json_skip_string_chars_fn)(const char *p, const char *end) = c_json_skip_string_chars_resolve;
+static const char *(*c_json_skip_string_chars_utf8_fn)(const char *p, const char *end) = c_json_skip_string_chars_utf8_resolve;
+static const char *(*c_json_skip_structure_chars_fn)(const char *p, const char *end) = c_json_skip_structure_chars_resolve;
+
+static void c_json_scan_resolve(void) {
+        const char *(*string_fn)(const char *p, const char *end) = c_json_skip_string_chars_scalar;
+        const char *(*string_utf8_fn)(const char *p, const char *end) = c_json_skip_string_chars_utf8_scalar;
+        const char *(*structure_fn)(const char *p, const char *end) = c_json_skip_structure_chars_scalar;
+
+#if defined(C_JSON_SCAN_SSE2)
+        string_fn = c_json_skip_string_chars_sse2;
+        string_utf8_fn = c_json_skip_string_chars_utf8_sse2;
+        structure_fn = c_json_skip_structure_chars_sse2;
+#endif
+#if defined(C_JSON_SCAN_AVX2)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+                string_fn = c_json_skip_string_chars_avx2;
+                string_utf8_fn = c_json_skip_string_chars_utf8_avx2;
+                structure_fn = c_json_skip_structure_chars_avx2;
+        }
+#endif
+#if defined(C_JSON_SCAN_NEON)
+        string_fn = c_json_skip_string_chars_neon;
+        string_utf8_fn = c_json_skip_string_chars_utf8_neon;
+        structure_fn = c_json_skip_structure_chars_neon;
+#endif
+
+        __atomic_store_n(&c_json_skip_string_chars_fn, string_fn, __ATOMIC_RELAXED);
+        __atomic_store_n(&c_json_skip_string_chars_utf8_fn, string_utf8_fn, __ATOMIC_RELAXED);
+        __atomic_store_n(&c_json_skip_structure_chars_fn, structure_fn, __ATOMIC_RELAXED);
+}
+
+static const char *c_json_skip_string_chars_resolve(const char *p, const char *end) {
+        c_json_scan_resolve();
+        return c_json_skip_string_chars(p, end);
+}
+
+static const char *c_json_skip_string_chars_utf8_resolve(const char *p, const char *end) {
+        c_json_scan_resolve();
+        return c_json_skip_string_chars_utf8(p, end);
+}
+
+static const char *c_json_skip_structure_chars_resolve(const char *p, const char *end) {
+        c_json_scan_resolve();
+        return c_json_skip_structure_chars(p, end);
+}
+
+const char *c_json_skip_string_chars(const char *p, const char *end) {
+        return __atomic_load_n(&c_json_skip_string_chars_fn, __ATOMIC_RELAXED)(p, end);
+}
+
+const char *c_json_skip_string_chars_utf8(const char *p, const char *end) {
+        return __atomic_load_n(&c_json_skip_string_chars_utf8_fn, __ATOMIC_RELAXED)(p, end);
+}
+
+const char *c_json_skip_structure_chars(const char *p, const char *end) {
+        return __atomic_load_n(&c_json_skip_structure_chars_fn, __ATOMIC_RELAXED)(p, end);
+}
+
+/*
+ * Follows table 3-7 of the Unicode standard: the second byte of a
+ * sequence has a narrower range after some leading bytes, which rules out
+ * overlong forms, surrogates and code points above U+10FFFF.
+ */
+size_t c_json_utf8_sequence(const char *p, const char *end) {
+        uint8_t c = (uint8_t)p[0], lo = 0x80, hi = 0xbf;
+        size_t n;
+
+        switch (c) {
+                case 0xc2 ... 0xdf:
+                        n = 2;
+                        break;
+                case 0xe0:
+                        n = 3;
+                        lo = 0xa0;
+                        break;
+                case 0xed:
+                        n = 3;
+                        hi = 0x9f;
+                        break;
+                case 0xe1 ... 0xec:
+                case 0xee ... 0xef:
+                        n = 3;
+                        break;
+                case 0xf0:
+                        n = 4;
+                        lo = 0x90;
+                        break;
+                case 0xf1 ... 0xf3:
+                        n = 4;
+                        break;
+                case 0xf4:
+                        n = 4;
+                        hi = 0x8f;
+                        break;
+                default:
+                        return 0;
+        }
+
+        if (p + 1 >= end)
+                return SIZE_MAX;
+        if ((uint8_t)p[1] < lo || (uint8_t)p[1] > hi)
+                return 0;
+
+        for (size_t i = 2; i < n; i += 1) {
+                if (p + i >= end)
+                        return SIZE_MAX;
+                if (((uint8_t)p[i] & 0xc0) != 0x80)
+                        return 0;
+        }
+
+        return n;
+}
@@ -0,0 +1,176 @@
+/*
+ * Struct Binding
+ *
+ * A struct descriptor is compiled from a static table of fields, each
+ * naming a key, the type of the member that its value is stored in, and
+ * the offset of that member. Nested objects are described by a nested
+ * table, which is compiled along with its parent. Reading an object then
+ * dispatches each key through the key set of its descriptor, and stores
+ * values straight into the members.
+ */
+
+#include <c-stdaux.h>
+#include <stdlib.h>
+#include "c-json.h"
+#include "c-json-private.h"
+
+typedef struct CJsonStructField {
+        unsigned int type;
+        size_t offset;
+        CJsonStruct *nested;
+} CJsonStructField;
+
+struct CJsonStruct {
+        CJsonKeySet *keys;
+        size_t n_fields;
+        CJsonStructField fields[];
+};
+
+/**
+ * c_json_struct_new() - compile a struct descriptor
+ * @structp:            return location
+ * @fields:             table of fields
+ * @n_fields:           number of fields
+ *
+ * Compiles @fields and the tables of nested objects they refer to, which
+ * must not refer back to @fields. The tables are usually static, and are
+ * not needed once this returns. See c_json_read_struct().
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ *         -EINVAL if a key is given more than once in the same table
+ */
+_c_public_ int c_json_struct_new(CJsonStruct **structp, const CJsonField *fields, size_t n_fields) {
+        _c_cleanup_(c_json_struct_freep) CJsonStruct *desc = NULL;
+        _c_cleanup_(c_freep) const char **keys = NULL;
+        int r;
+
+        desc = calloc(1, sizeof(*desc) + n_fields * sizeof(*desc->fields));
+        keys = calloc(n_fields + 1, sizeof(*keys));
+        if (!desc || !keys)
+                return -ENOMEM;
+
+        desc->n_fields = n_fields;
+
+        for (size_t i = 0; i < n_fields; i += 1) {
+                keys[i] = fields[i].key;
+                desc->fields[i].type = fields[i].type;
+                desc->fields[i].offset = fields[i].offset;
+
+                if (fields[i].type == C_JSON_FIELD_OBJECT) {
+                        r = c_json_struct_new(&desc->fields[i].nested, fields[i].fields, fields[i].n_fields);
+                        if (r)
+                                return r;
+                }
+        }
+
+        r = c_json_key_set_new(&desc->keys, keys, n_fields);
+        if (r)
+                return r;
+
+        *structp = desc;
+        desc = NULL;
+
+        return 0;
+}
+
+/**
+ * c_json_struct_free() - free a struct descriptor
+ * @desc:               descriptor to free, or NULL
+ *
+ * Return: NULL
+ */
+_c_public_ CJsonStruct * c_json_struct_free(CJsonStruct *desc) {
+        if (!desc)
+                return NULL;
+
+        for (size_t i = 0; i < desc->n_fields; i += 1)
+                c_json_struct_free(desc->fields[i].nested);
+        c_json_key_set_free(desc->keys);
+        free(desc);
+
+        return NULL;
+}
+
+/**
+ * c_json_read_struct() - read an object into a struct
+ * @json                json object
+ * @desc                descriptor of the struct
+ * @out                 struct to read into
+ *
+ * Reads the next value, which must be an object, and stores the value of
+ * each member whose key is part of @desc into the member of @out that its
+ * field describes. Members with other keys are skipped, and members of
+ * @out whose key does not appear keep their values, so defaults can be
+ * set up front. If a key appears more than once, the last value wins, and
+ * an earlier string is not freed.
+ *
+ * Values are read as by the reader for the type of their field, and must
+ * have that type, so `null` is not accepted in place of any of them.
+ * C_JSON_FIELD_STRING members are set as by c_json_read_string(), so
+ * nothing is allocated if the reader has an arena, or reads in place, in
+ * which case strings without escape sequences are borrowed from the
+ * input. Otherwise, they must be freed, including those that were stored
+ * before a failure.
+ *
+ * This does not support input that is fed incrementally.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if the next value, or the value of a field,
+ *         does not have the expected type
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_OUT_OF_RANGE if an integer does not fit into its field
+ */
+_c_public_ int c_json_read_struct(CJson *json, const CJsonStruct *desc, void *out) {
+        const CJsonStructField *field;
+        size_t index;
+        void *member;
+        int r;
+
+        assert(!json->feeding);
+
+        r = c_json_open_object(json);
+        if (r)
+                return r;
+
+        for (;;) {
+                r = c_json_find_keys(json, desc->keys, &index);
+                if (r)
+                        return r;
+                if (index == C_JSON_KEY_NONE)
+                        break;
+
+                field = &desc->fields[index];
+                member = (char *)out + field->offset;
+
+                switch (field->type) {
+                        case C_JSON_FIELD_BOOL:
+                                r = c_json_read_bool(json, member);
+                                break;
+                        case C_JSON_FIELD_U64:
+                                r = c_json_read_u64(json, member);
+                                break;
+                        case C_JSON_FIELD_I64:
+                                r = c_json_read_i64(json, member);
+                                break;
+                        case C_JSON_FIELD_F64:
+                                r = c_json_read_f64(json, member);
+                                break;
+                        case C_JSON_FIELD_STRING:
+                                r = c_json_read_string(json, member);
+                                break;
+                        case C_JSON_FIELD_OBJECT:
+                                r = c_json_read_struct(json, field->nested, member);
+                                break;
+                        default:
+                                r = c_json_skip(json);
+                                break;
+                }
+                if (r)
+                        return r;
+        }
+
+        return c_json_close_object(json);
+}
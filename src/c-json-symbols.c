@@ -0,0 +1,294 @@
+/*
+ * Symbol Tables
+ *
+ * A symbol table interns object keys: each distinct key is copied once
+ * and assigned a small, dense ID, and every later occurrence resolves to
+ * the same copy and ID without allocating. Keys are kept in an open
+ * addressing hash table with linear probing, which holds the ID + 1 of
+ * each symbol, and their strings are allocated from blocks that are never
+ * moved, so the strings handed out stay valid as the table grows.
+ */
+
+#include <c-stdaux.h>
+#include <stdlib.h>
+#include "c-json.h"
+#include "c-json-private.h"
+
+#define C_JSON_SYMBOLS_BLOCK (4096 - sizeof(CJsonSymbolBlock))
+
+typedef struct CJsonSymbol {
+        const char *key;
+        size_t n_key;
+        uint64_t hash;
+} CJsonSymbol;
+
+typedef struct CJsonSymbolBlock CJsonSymbolBlock;
+
+struct CJsonSymbolBlock {
+        CJsonSymbolBlock *next;
+        char data[];
+};
+
+struct CJsonSymbols {
+        size_t n_max;
+        bool frozen : 1;
+
+        CJsonSymbol *symbols;
+        size_t n_symbols;
+        size_t z_symbols;
+
+        /* ID + 1 of the symbol in each slot, or 0 if it is empty */
+        uint32_t *slots;
+        size_t mask;
+
+        /* @p and @n describe the free part of the first block */
+        CJsonSymbolBlock *blocks;
+        char *p;
+        size_t n;
+};
+
+/**
+ * c_json_symbols_new() - allocate a symbol table
+ * @symbolsp:           return location
+ * @n_max:              maximum number of symbols
+ *
+ * Input decides which keys are interned, so @n_max bounds the memory
+ * that documents with many distinct keys can make the table use. Once
+ * it is reached, keys that are not part of the table yet are treated as
+ * if it was frozen, see c_json_symbols_freeze().
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ */
+_c_public_ int c_json_symbols_new(CJsonSymbols **symbolsp, size_t n_max) {
+        CJsonSymbols *symbols;
+
+        symbols = calloc(1, sizeof(*symbols));
+        if (!symbols)
+                return -ENOMEM;
+
+        symbols->n_max = c_min(n_max, (size_t)UINT32_MAX / 2);
+
+        *symbolsp = symbols;
+
+        return 0;
+}
+
+/**
+ * c_json_symbols_free() - free a symbol table
+ * @symbols:            symbol table to free, or NULL
+ *
+ * The strings of all symbols are freed along with the table, and readers
+ * that it is set on must not be used anymore.
+ *
+ * Return: NULL
+ */
+_c_public_ CJsonSymbols * c_json_symbols_free(CJsonSymbols *symbols) {
+        CJsonSymbolBlock *block;
+
+        if (!symbols)
+                return NULL;
+
+        while ((block = symbols->blocks)) {
+                symbols->blocks = block->next;
+                free(block);
+        }
+
+        free(symbols->slots);
+        free(symbols->symbols);
+        free(symbols);
+
+        return NULL;
+}
+
+/**
+ * c_json_symbols_freeze() - stop adding symbols to a table
+ * @symbols:            symbol table
+ *
+ * After this, keys that are not part of @symbols are no longer added to
+ * it, and the table is never written to again. Hence, a frozen table may
+ * be shared by readers on different threads.
+ */
+_c_public_ void c_json_symbols_freeze(CJsonSymbols *symbols) {
+        symbols->frozen = true;
+}
+
+static int c_json_symbols_rehash(CJsonSymbols *symbols, size_t n_slots) {
+        uint32_t *slots;
+        size_t slot;
+
+        slots = calloc(n_slots, sizeof(*slots));
+        if (!slots)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < symbols->n_symbols; i += 1) {
+                slot = symbols->symbols[i].hash & (n_slots - 1);
+                while (slots[slot])
+                        slot = (slot + 1) & (n_slots - 1);
+
+                slots[slot] = i + 1;
+        }
+
+        free(symbols->slots);
+        symbols->slots = slots;
+        symbols->mask = n_slots - 1;
+
+        return 0;
+}
+
+static char *c_json_symbols_alloc(CJsonSymbols *symbols, size_t n) {
+        CJsonSymbolBlock *block;
+        size_t n_block;
+        char *p;
+
+        if (n > symbols->n) {
+                n_block = c_max(n, C_JSON_SYMBOLS_BLOCK);
+
+                block = malloc(sizeof(*block) + n_block);
+                if (!block)
+                        return NULL;
+
+                block->next = symbols->blocks;
+                symbols->blocks = block;
+                symbols->p = block->data;
+                symbols->n = n_block;
+        }
+
+        p = symbols->p;
+        symbols->p += n;
+        symbols->n -= n;
+
+        return p;
+}
+
+/*
+ * Looks up @key in @symbols, and adds it unless the table is frozen or
+ * full.
+ *
+ * Return: <0 on fatal failures
+ *         0 on success, with *@idp set to the ID of @key, or
+ *         C_JSON_KEY_NONE if it is not part of the table and cannot be
+ *         added
+ */
+int c_json_symbols_intern(CJsonSymbols *symbols, const char *key, size_t n_key, size_t *idp) {
+        uint64_t hash = c_json_hash(0, key, n_key);
+        CJsonSymbol *symbol;
+        size_t slot;
+        char *copy;
+        int r;
+
+        if (symbols->slots) {
+                for (slot = hash & symbols->mask; symbols->slots[slot]; slot = (slot + 1) & symbols->mask) {
+                        symbol = &symbols->symbols[symbols->slots[slot] - 1];
+                        if (symbol->hash == hash && symbol->n_key == n_key && !memcmp(symbol->key, key, n_key)) {
+                                *idp = symbols->slots[slot] - 1;
+                                return 0;
+                        }
+                }
+        }
+
+        if (symbols->frozen || symbols->n_symbols >= symbols->n_max) {
+                *idp = C_JSON_KEY_NONE;
+                return 0;
+        }
+
+        if (symbols->n_symbols >= symbols->z_symbols) {
+                size_t z = c_max(symbols->z_symbols * 2, (size_t)16);
+
+                symbol = realloc(symbols->symbols, z * sizeof(*symbol));
+                if (!symbol)
+                        return -ENOMEM;
+
+                symbols->symbols = symbol;
+                symbols->z_symbols = z;
+        }
+
+        /* at most half full, so probe sequences stay short */
+        if (2 * (symbols->n_symbols + 1) > symbols->mask + 1 || !symbols->slots) {
+                r = c_json_symbols_rehash(symbols, symbols->slots ? 2 * (symbols->mask + 1) : 32);
+                if (r)
+                        return r;
+        }
+
+        copy = c_json_symbols_alloc(symbols, n_key + 1);
+        if (!copy)
+                return -ENOMEM;
+
+        memcpy(copy, key, n_key);
+        copy[n_key] = '\0';
+
+        symbol = &symbols->symbols[symbols->n_symbols];
+        symbol->key = copy;
+        symbol->n_key = n_key;
+        symbol->hash = hash;
+
+        for (slot = hash & symbols->mask; symbols->slots[slot]; slot = (slot + 1) & symbols->mask)
+                ;
+        symbols->slots[slot] = ++symbols->n_symbols;
+
+        *idp = symbols->n_symbols - 1;
+
+        return 0;
+}
+
+/**
+ * c_json_symbols_add() - add a key to a symbol table
+ * @symbols:            symbol table
+ * @key:                key to add, in UTF-8
+ * @n_key:              length of @key
+ * @idp:                return location for the ID of @key, or NULL
+ *
+ * Adds @key unless it is part of @symbols already. This allows setting up
+ * a table with the keys of a schema, in an order that gives them known
+ * IDs, before it is frozen. IDs are assigned in the order keys are added,
+ * starting at 0.
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ *         -ENOSPC if @key is not part of @symbols, and the table is frozen
+ *         or full
+ */
+_c_public_ int c_json_symbols_add(CJsonSymbols *symbols, const char *key, size_t n_key, size_t *idp) {
+        size_t id;
+        int r;
+
+        r = c_json_symbols_intern(symbols, key, n_key, &id);
+        if (r)
+                return r;
+        if (id == C_JSON_KEY_NONE)
+                return -ENOSPC;
+
+        if (idp)
+                *idp = id;
+
+        return 0;
+}
+
+/**
+ * c_json_symbols_get() - look up a symbol by its ID
+ * @symbols:            symbol table
+ * @id:                 ID of the symbol
+ * @np:                 return location for the length of the key, or NULL
+ *
+ * Return: the 0-terminated key of the symbol, valid as long as @symbols,
+ *         or NULL if there is no symbol with this ID
+ */
+_c_public_ const char * c_json_symbols_get(const CJsonSymbols *symbols, size_t id, size_t *np) {
+        if (id >= symbols->n_symbols)
+                return NULL;
+
+        if (np)
+                *np = symbols->symbols[id].n_key;
+
+        return symbols->symbols[id].key;
+}
+
+/**
+ * c_json_symbols_count() - count the symbols of a table
+ * @symbols:            symbol table
+ *
+ * Return: the number of symbols, all of which have IDs below it
+ */
+_c_public_ size_t c_json_symbols_count(const CJsonSymbols *symbols) {
+        return symbols->n_symbols;
+}
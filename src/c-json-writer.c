@@ -0,0 +1,561 @@
+/*
+ * Writer
+ *
+ * The writer mirrors the reader: values are written one by one, with the
+ * same nesting states and the same poison model. Output is collected in
+ * a buffer that either grows to hold the whole document, or is handed to
+ * a flush callback whenever it fills up.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <math.h>
+#include <stdlib.h>
+#include "c-json.h"
+#include "c-json-private.h"
+
+#define C_JSON_FLUSH_SIZE 4096
+
+static int c_json_out_flush(CJson *json) {
+        int r;
+
+        if (!json->n_out)
+                return 0;
+
+        r = json->flush(json->userdata, json->out, json->n_out);
+        if (r)
+                return r < 0 ? r : -EIO;
+
+        json->n_out = 0;
+
+        return 0;
+}
+
+/*
+ * Makes sure @json->out has room for @n more bytes, plus a 0-terminator
+ * when it grows to hold the whole document.
+ */
+static int c_json_out_reserve(CJson *json, size_t n) {
+        size_t z_out;
+        char *out;
+
+        z_out = json->flush ? C_JSON_FLUSH_SIZE : c_max(json->z_out * 2, json->n_out + n + 1);
+        if (z_out < 64)
+                z_out = 64;
+
+        out = realloc(json->out, z_out);
+        if (!out)
+                return -ENOMEM;
+
+        json->out = out;
+        json->z_out = z_out;
+
+        return 0;
+}
+
+static int c_json_put(CJson *json, const char *data, size_t n) {
+        int r;
+
+        if (!n)
+                return 0;
+
+        if (_c_unlikely_(json->z_out - json->n_out < n + !json->flush)) {
+                if (json->flush) {
+                        /* the buffer may be left over from a previous document */
+                        if (json->z_out < C_JSON_FLUSH_SIZE) {
+                                r = c_json_out_reserve(json, n);
+                                if (r)
+                                        return r;
+                        }
+
+                        if (json->z_out - json->n_out < n) {
+                                r = c_json_out_flush(json);
+                                if (r)
+                                        return r;
+                        }
+
+                        /* too large to be worth buffering */
+                        if (n >= json->z_out) {
+                                r = json->flush(json->userdata, data, n);
+                                return r ? (r < 0 ? r : -EIO) : 0;
+                        }
+                } else {
+                        r = c_json_out_reserve(json, n);
+                        if (r)
+                                return r;
+                }
+        }
+
+        memcpy(json->out + json->n_out, data, n);
+        json->n_out += n;
+
+        return 0;
+}
+
+static int c_json_put_string(CJson *json, const char *string, size_t n) {
+        static const char hex[] = "0123456789abcdef";
+        const char *end = string + n, *p;
+        char escape[6];
+        size_t n_escape;
+        int r;
+
+        r = c_json_put(json, "\"", 1);
+        if (r)
+                return r;
+
+        for (;;) {
+                /* the same scan that finds the end of strings when reading */
+                p = c_json_skip_string_chars(string, end);
+
+                r = c_json_put(json, string, p - string);
+                if (r)
+                        return r;
+
+                if (p >= end)
+                        break;
+
+                escape[0] = '\\';
+                n_escape = 2;
+
+                switch (*p) {
+                        case '"':
+                        case '\\':
+                                escape[1] = *p;
+                                break;
+                        case '\b':
+                                escape[1] = 'b';
+                                break;
+                        case '\f':
+                                escape[1] = 'f';
+                                break;
+                        case '\n':
+                                escape[1] = 'n';
+                                break;
+                        case '\r':
+                                escape[1] = 'r';
+                                break;
+                        case '\t':
+                                escape[1] = 't';
+                                break;
+                        default:
+                                memcpy(escape + 1, "u00", 3);
+                                escape[4] = hex[(uint8_t)*p >> 4];
+                                escape[5] = hex[(uint8_t)*p & 0xf];
+                                n_escape = 6;
+                                break;
+                }
+
+                r = c_json_put(json, escape, n_escape);
+                if (r)
+                        return r;
+
+                string = p + 1;
+        }
+
+        return c_json_put(json, "\"", 1);
+}
+
+/*
+ * Writes what goes in front of the next value, after checking that a
+ * value may follow. Only strings may be written where a key is expected.
+ */
+static int c_json_write_prefix(CJson *json, bool string) {
+        switch (json->state) {
+                case ']':
+                        if (json->level == 0)
+                                return C_JSON_E_INVALID_TYPE;
+                        return c_json_put(json, ",", 1);
+
+                case '{':
+                        return string ? 0 : C_JSON_E_INVALID_TYPE;
+
+                case '}':
+                        return string ? c_json_put(json, ",", 1) : C_JSON_E_INVALID_TYPE;
+        }
+
+        return 0;
+}
+
+/*
+ * Moves on to the next state after a value has been written.
+ */
+static int c_json_write_suffix(CJson *json) {
+        switch (json->state) {
+                case 0:
+                case '[':
+                        json->state = ']';
+                        break;
+
+                case '{':
+                case '}':
+                        json->state = ':';
+                        return c_json_put(json, ":", 1);
+
+                case ':':
+                        json->state = '}';
+                        break;
+        }
+
+        return 0;
+}
+
+static int c_json_write_scalar(CJson *json, const char *data, size_t n) {
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        r = c_json_write_prefix(json, false);
+        if (r)
+                return (json->poison = r);
+
+        r = c_json_put(json, data, n);
+        if (r)
+                return (json->poison = r);
+
+        r = c_json_write_suffix(json);
+        if (r)
+                return (json->poison = r);
+
+        return 0;
+}
+
+static int c_json_write_open(CJson *json, char open) {
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        r = c_json_write_prefix(json, false);
+        if (r)
+                return (json->poison = r);
+
+        if (json->level >= json->n_states)
+                return (json->poison = C_JSON_E_DEPTH_OVERFLOW);
+
+        r = c_json_put(json, &open, 1);
+        if (r)
+                return (json->poison = r);
+
+        c_json_push(json, open);
+
+        return 0;
+}
+
+static int c_json_write_close(CJson *json, char close) {
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        /* the opening bracket, or the state behind a value */
+        if (json->level == 0 ||
+            (json->state != close - 2 && json->state != close))
+                return (json->poison = C_JSON_E_INVALID_TYPE);
+
+        r = c_json_put(json, &close, 1);
+        if (r)
+                return (json->poison = r);
+
+        c_json_pop(json);
+
+        r = c_json_write_suffix(json);
+        if (r)
+                return (json->poison = r);
+
+        return 0;
+}
+
+/*
+ * Drops all output and writer state.
+ */
+void c_json_stop_write(CJson *json) {
+        json->level = 0;
+        json->state = 0;
+        json->n_out = 0;
+        json->flush = NULL;
+        json->userdata = NULL;
+        json->writing = false;
+}
+
+/**
+ * c_json_begin_write() - begin writing JSON
+ * @json                json object
+ * @flush               callback that consumes the output, or NULL
+ * @userdata            argument passed to @flush
+ *
+ * Starts writing a single JSON document. Without @flush, the output is
+ * collected in a buffer that is returned by c_json_end_write(). With
+ * @flush, the output is passed to @flush in chunks whenever the internal
+ * buffer fills up, and once more by c_json_end_write(). @flush must
+ * return 0 on success. Any other value stops writing and is returned by
+ * every further call, a positive one as -EIO.
+ *
+ * It is an error to call this function while reading, or multiple times
+ * without calling c_json_end_write().
+ */
+_c_public_ void c_json_begin_write(CJson *json, CJsonFlushFn flush, void *userdata) {
+        assert(!json->input && !json->writing);
+
+        json->flush = flush;
+        json->userdata = userdata;
+        json->writing = true;
+}
+
+/**
+ * c_json_end_write() - end writing
+ * @json                json object
+ * @datap               return location for the output, or NULL
+ * @n_datap             return location for the length of the output, or NULL
+ *
+ * Completes the document. Without a flush callback, the 0-terminated
+ * output is returned in @datap and must be freed, or discarded if @datap
+ * is NULL. With a flush callback, the rest of the output is flushed and
+ * @datap is not touched.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if the document is not complete
+ */
+_c_public_ int c_json_end_write(CJson *json, char **datap, size_t *n_datap) {
+        int r = json->poison;
+
+        assert(json->writing);
+
+        if (!r && (json->level > 0 || json->state != ']'))
+                r = C_JSON_E_INVALID_TYPE;
+
+        if (!r && json->flush)
+                r = c_json_out_flush(json);
+
+        if (!r && !json->flush && datap) {
+                json->out[json->n_out] = '\0';
+                *datap = json->out;
+                if (n_datap)
+                        *n_datap = json->n_out;
+                json->out = NULL;
+                json->z_out = 0;
+        }
+
+        c_json_stop_write(json);
+
+        return r;
+}
+
+/**
+ * c_json_write_null() - write `null`
+ * @json                json object
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if a key is expected or the document is complete
+ */
+_c_public_ int c_json_write_null(CJson *json) {
+        return c_json_write_scalar(json, "null", 4);
+}
+
+/**
+ * c_json_write_bool() - write a boolean
+ * @json                json object
+ * @b                   boolean to write
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if a key is expected or the document is complete
+ */
+_c_public_ int c_json_write_bool(CJson *json, bool b) {
+        return b ? c_json_write_scalar(json, "true", 4) : c_json_write_scalar(json, "false", 5);
+}
+
+/**
+ * c_json_write_string_n() - write a string of known length
+ * @json                json object
+ * @string              string to write, in UTF-8
+ * @n                   length of @string
+ *
+ * Writes @string with '"', '\\' and control characters escaped. Where a
+ * key is expected, this writes the key. Other bytes are copied verbatim,
+ * so @string must be valid UTF-8 for the output to be valid JSON.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if the document is complete
+ */
+_c_public_ int c_json_write_string_n(CJson *json, const char *string, size_t n) {
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        r = c_json_write_prefix(json, true);
+        if (r)
+                return (json->poison = r);
+
+        r = c_json_put_string(json, string, n);
+        if (r)
+                return (json->poison = r);
+
+        r = c_json_write_suffix(json);
+        if (r)
+                return (json->poison = r);
+
+        return 0;
+}
+
+/**
+ * c_json_write_string() - write a string
+ * @json                json object
+ * @string              0-terminated string to write, in UTF-8
+ *
+ * See c_json_write_string_n().
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if the document is complete
+ */
+_c_public_ int c_json_write_string(CJson *json, const char *string) {
+        return c_json_write_string_n(json, string, strlen(string));
+}
+
+static size_t c_json_format_u64(uint64_t number, bool negative, char *buffer) {
+        char digits[20], *p = digits + sizeof(digits);
+        size_t n = 0;
+
+        do {
+                *--p = '0' + number % 10;
+                number /= 10;
+        } while (number);
+
+        if (negative)
+                buffer[n++] = '-';
+
+        memcpy(buffer + n, p, digits + sizeof(digits) - p);
+
+        return n + (digits + sizeof(digits) - p);
+}
+
+/**
+ * c_json_write_u64() - write an unsigned integer
+ * @json                json object
+ * @number              integer to write
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if a key is expected or the document is complete
+ */
+_c_public_ int c_json_write_u64(CJson *json, uint64_t number) {
+        char buffer[21];
+
+        return c_json_write_scalar(json, buffer, c_json_format_u64(number, false, buffer));
+}
+
+/**
+ * c_json_write_i64() - write a signed integer
+ * @json                json object
+ * @number              integer to write
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if a key is expected or the document is complete
+ */
+_c_public_ int c_json_write_i64(CJson *json, int64_t number) {
+        char buffer[21];
+        size_t n;
+
+        if (number < 0)
+                n = c_json_format_u64(0 - (uint64_t)number, true, buffer);
+        else
+                n = c_json_format_u64(number, false, buffer);
+
+        return c_json_write_scalar(json, buffer, n);
+}
+
+/**
+ * c_json_write_f64() - write a number
+ * @json                json object
+ * @number              number to write
+ *
+ * Writes the shortest decimal that reads back as exactly @number.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if a key is expected or the document is complete
+ *         C_JSON_E_OUT_OF_RANGE if @number is infinite or NaN
+ */
+_c_public_ int c_json_write_f64(CJson *json, double number) {
+        char buffer[C_JSON_F64_MAX];
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        if (!isfinite(number))
+                return (json->poison = C_JSON_E_OUT_OF_RANGE);
+
+        return c_json_write_scalar(json, buffer, c_json_format_f64(number, buffer));
+}
+
+/**
+ * c_json_write_open_array() - begin writing an array
+ * @json                json object
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if a key is expected or the document is complete
+ *         C_JSON_E_DEPTH_OVERFLOW if the nesting depth is too high
+ */
+_c_public_ int c_json_write_open_array(CJson *json) {
+        return c_json_write_open(json, '[');
+}
+
+/**
+ * c_json_write_close_array() - finish writing an array
+ * @json                json object
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if not currently in an array
+ */
+_c_public_ int c_json_write_close_array(CJson *json) {
+        return c_json_write_close(json, ']');
+}
+
+/**
+ * c_json_write_open_object() - begin writing an object
+ * @json                json object
+ *
+ * Keys and values are then written alternately, keys with
+ * c_json_write_string().
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if a key is expected or the document is complete
+ *         C_JSON_E_DEPTH_OVERFLOW if the nesting depth is too high
+ */
+_c_public_ int c_json_write_open_object(CJson *json) {
+        return c_json_write_open(json, '{');
+}
+
+/**
+ * c_json_write_close_object() - finish writing an object
+ * @json                json object
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a writer function
+ *         C_JSON_E_INVALID_TYPE if not currently in an object, or a key
+ *         has no value yet
+ */
+_c_public_ int c_json_write_close_object(CJson *json) {
+        return c_json_write_close(json, '}');
+}
@@ -2,48 +2,169 @@
 #include <assert.h>
 #include <ctype.h>
 #include <c-stdaux.h>
-#include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "c-json.h"
+#include "c-json-private.h"
 
-struct CJson {
-        const char *input;
-
-        /*
-         * Current position in the input. Always points to the start of
-         * the next value.
-         */
-        const char *p;
-
-        /*
-         * Last error code. If it is non-zero, every function turns into
-         * a no-op and returns this value.
-         */
-        int poison;
-
-        /*
-         * State for each nesting level. @n_states is the maximum
-         * nesting depth. For each level, the state can be:
-         *
-         *  0: root level
-         *
-         *  '[': in an array and @p points to the next value or ']'
-         *  ',': in an array and @p is behind a ','
-         *
-         *  '{': in an object and @p points to the next key
-         *  ':': in an object and @p points to the next value
-         */
-        size_t n_states;
-        size_t level;
-        char states[];
-};
-
-static const char * skip_space(const char *p) {
-        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
-                p += 1;
+static inline bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
-        return p;
+/*
+ * Most tokens are followed by no or a single space. Only hand off to
+ * the vectorized scan for longer runs, like indentation.
+ */
+static inline const char * skip_space(CJson *json, const char *p) {
+        const char *end = json->end, *next;
+
+        if (_c_likely_(!is_space(c_json_char(p, end))))
+                return p;
+        if (!is_space(c_json_char(p + 1, end))) {
+                c_json_stat(json, n_space, 1);
+                return p + 1;
+        }
+
+        next = c_json_skip_space_chars(p + 2, end);
+        c_json_stat(json, n_space, next - p);
+
+        return next;
+}
+
+/*
+ * Returns the byte at @json->p, or 0 at the end of the input.
+ */
+static inline char current(const CJson *json) {
+        return c_json_char(json->p, json->end);
+}
+
+/*
+ * Returns the first entry of the structural index at or behind @p, or
+ * @json->end if there is none. Readers only move forward, so the cursor
+ * does as well.
+ */
+static inline const char *c_json_index_seek(CJson *json, const char *p) {
+        size_t offset = p - json->input;
+
+        while (json->index.cursor < json->index.n && json->index.positions[json->index.cursor] < offset)
+                json->index.cursor += 1;
+
+        if (json->index.cursor >= json->index.n)
+                return json->end;
+
+        return json->input + json->index.positions[json->index.cursor];
+}
+
+/*
+ * Validates the UTF-8 in the run of string characters at @p, and returns
+ * where it ends, or the start of the first sequence that is malformed.
+ * Indexed runs end at the next entry, and are validated up to it.
+ */
+static const char *c_json_string_run_utf8(CJson *json, const char *p) {
+        const char *end = json->indexed ? c_json_index_seek(json, p) : json->end;
+        size_t n;
+
+        for (;;) {
+                p = c_json_skip_string_chars_utf8(p, end);
+                if (p >= end || (uint8_t)*p < 0x80)
+                        return p;
+
+                do {
+                        n = c_json_utf8_sequence(p, end);
+                        if (!n)
+                                return p;
+
+                        /* a sequence cut off by the input may still be completed by feeding more */
+                        if (n == SIZE_MAX)
+                                return end == json->end ? end : p;
+
+                        p += n;
+                } while (p < end && (uint8_t)*p >= 0x80);
+        }
+}
+
+/*
+ * Like c_json_skip_string_chars(). Within a string, the index has an
+ * entry for exactly the bytes that the scan stops at. With
+ * C_JSON_FLAG_UTF8, the run also stops at malformed UTF-8, so anything
+ * but '"' and '\\' ends the string in error.
+ */
+static inline const char *c_json_string_run(CJson *json, const char *p) {
+        if (_c_unlikely_(json->flags & C_JSON_FLAG_UTF8))
+                return c_json_string_run_utf8(json, p);
+
+        if (json->indexed)
+                return c_json_index_seek(json, p);
+
+        return c_json_skip_string_chars(p, json->end);
+}
+
+/*
+ * Like c_json_skip_structure_chars(), but jumps over the ':' and ','
+ * entries of the index.
+ */
+static inline const char *c_json_structure_run(CJson *json, const char *p) {
+        const char *next;
+
+        if (!json->indexed)
+                return c_json_skip_structure_chars(p, json->end);
+
+        for (;;) {
+                next = c_json_index_seek(json, p);
+                if (next >= json->end || (*next != ':' && *next != ','))
+                        return next;
+                p = next + 1;
+        }
+}
+
+/*
+ * Saves the position at the start of a reader, see @mark.
+ */
+static inline void c_json_mark(CJson *json) {
+        if (_c_likely_(!json->feeding))
+                return;
+
+        json->mark.p = json->p;
+        json->mark.level = json->level;
+        json->mark.state = json->state;
+}
+
+static int c_json_again(CJson *json) {
+        json->p = json->mark.p;
+        json->level = json->mark.level;
+        json->state = json->mark.state;
+
+        return C_JSON_E_AGAIN;
+}
+
+/*
+ * Whether a reader has reached the end of the input fed so far, and
+ * needs more of it before it can decide.
+ */
+static inline bool c_json_starved(CJson *json) {
+        return _c_unlikely_(json->feeding) && json->p >= json->end && !json->final;
+}
+
+/*
+ * Fails the current reader with @r, which must be positive or a
+ * negative error code, and poisons @json. A failure caused by running
+ * out of incremental input is rolled back instead.
+ */
+static int c_json_fail(CJson *json, int r) {
+        if (r > 0 && c_json_starved(json))
+                return c_json_again(json);
+
+        return (json->poison = r);
+}
+
+static inline void c_json_clear_stats(CJson *json) {
+#if defined(C_JSON_STATS) && C_JSON_STATS
+        json->stats = (CJsonStats){};
+#else
+        (void)json;
+#endif
 }
 
 /*
@@ -51,563 +172,1931 @@ static const char * skip_space(const char *p) {
  * excactly once after a value has been read.
  */
 static int c_json_advance(CJson *json) {
+        const char *end = json->p;
+
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        json->p = skip_space(json->p);
+        json->p = skip_space(json, json->p);
+
+        switch (json->state) {
+                case 0:
+                        json->adjacent = json->p == end && end[-1] != ']' && end[-1] != '}';
+                        break;
 
-        switch (json->states[json->level]) {
                 case '[':
-                        if (*json->p == ',') {
-                                json->states[json->level] = ',';
-                                json->p = skip_space(json->p + 1);
-                        } else if (*json->p != ']')
-                                return (json->poison = C_JSON_E_INVALID_JSON);
+                        if (current(json) == ',') {
+                                json->state = ',';
+                                json->p = skip_space(json, json->p + 1);
+                        } else if (current(json) != ']')
+                                return c_json_fail(json, C_JSON_E_INVALID_JSON);
                         break;
 
                 case ',':
-                        if (*json->p == ',')
-                                json->p = skip_space(json->p + 1);
-                        else if (*json->p == ']')
-                                json->states[json->level] = '[';
+                        if (current(json) == ',')
+                                json->p = skip_space(json, json->p + 1);
+                        else if (current(json) == ']')
+                                json->state = '[';
                         else
-                                return (json->poison = C_JSON_E_INVALID_JSON);
+                                return c_json_fail(json, C_JSON_E_INVALID_JSON);
                         break;
 
                 case '{':
-                        if (*json->p == ':') {
-                                json->states[json->level] = ':';
-                                json->p = skip_space(json->p + 1);
+                        if (current(json) == ':') {
+                                json->state = ':';
+                                json->p = skip_space(json, json->p + 1);
                         }
                         else
-                                return (json->poison = C_JSON_E_INVALID_JSON);
+                                return c_json_fail(json, C_JSON_E_INVALID_JSON);
                         break;
 
                 case ':':
-                        if (*json->p == ',') {
-                                json->states[json->level] = '{';
-                                json->p = skip_space(json->p + 1);
-                                if (*json->p != '"')
-                                        return (json->poison = C_JSON_E_INVALID_JSON);
-                        } else if (*json->p != '}')
-                                return (json->poison = C_JSON_E_INVALID_JSON);
+                        if (current(json) == ',') {
+                                json->state = '{';
+                                json->p = skip_space(json, json->p + 1);
+                                if (current(json) != '"')
+                                        return c_json_fail(json, C_JSON_E_INVALID_JSON);
+                        } else if (current(json) == '}')
+                                json->state = '}';
+                        else
+                                return c_json_fail(json, C_JSON_E_INVALID_JSON);
                         break;
         }
 
+        /* the next token might still continue this one */
+        if (c_json_starved(json))
+                return c_json_again(json);
+
         return 0;
 }
 
 /*
- * Reads a single utf-16 code unit and writes it to @unitp. Does not
- * do any unicode validation, as per the spec.
+ * Reads a single utf-16 code unit at @json->p and writes it to @unitp.
+ * Does not do any unicode validation, as per the spec.
  *
  * Return: 0 on success
- *         C_JSON_E_INVALID_JSON if @p does not point to a valid sequence
+ *         C_JSON_E_INVALID_JSON if @json->p does not point to a valid sequence
  */
-static int c_json_read_utf16_unit(const char *p, uint16_t *unitp) {
-        uint8_t digits[4];
+static int c_json_read_utf16_unit(CJson *json, uint16_t *unitp) {
+        uint16_t unit = 0;
 
         for (size_t i = 0; i < 4; i += 1) {
-                switch (p[i]) {
+                switch (current(json)) {
                         case '0' ... '9':
-                                digits[i] = p[i] - '0';
+                                unit = unit << 4 | (current(json) - '0');
                                 break;
 
                         case 'a' ... 'f':
-                                digits[i] = p[i] - 'a' + 0x0a;
+                                unit = unit << 4 | (current(json) - 'a' + 0x0a);
                                 break;
 
                         case 'A' ... 'F':
-                                digits[i] = p[i] - 'A' + 0x0a;
+                                unit = unit << 4 | (current(json) - 'A' + 0x0a);
                                 break;
 
                         default:
                                 return C_JSON_E_INVALID_JSON;
                 }
+
+                json->p += 1;
         }
 
-        *unitp = digits[0] << 12 | digits[1] << 8 | digits[2] << 4 | digits[3];
+        *unitp = unit;
 
         return 0;
 }
 
-static int c_json_write_utf8(uint32_t cp, FILE *stream) {
-	switch (cp) {
-	case  0x0000 ...   0x007F:
-                if (fputc((char)cp, stream) < 0)
-			return -ENOTRECOVERABLE;
-		break;
-	case  0x0080 ...   0x07FF:
-                if (fputc((char)(0xc0 | (cp >> 6)), stream) < 0)
-			return -ENOTRECOVERABLE;
-                if (fputc((char)(0x80 | (cp & 0x3f)), stream) < 0)
-			return -ENOTRECOVERABLE;
-		break;
-	case  0x0800 ...   0xFFFF:
-                if (fputc((char)(0xe0 | (cp >> 12)), stream) < 0)
-			return -ENOTRECOVERABLE;
-                if (fputc((char)(0x80 | ((cp >> 6) & 0x3f)), stream) < 0)
-			return -ENOTRECOVERABLE;
-                if (fputc((char)(0x80 | (cp & 0x3f)), stream) < 0)
-			return -ENOTRECOVERABLE;
-		break;
-	case 0x10000 ... 0x10FFFF:
-                if (fputc((char)(0xf0 | (cp >> 18)), stream) < 0)
-			return -ENOTRECOVERABLE;
-                if (fputc((char)(0x80 | ((cp >> 12) & 0x3f)), stream) < 0)
-			return -ENOTRECOVERABLE;
-                if (fputc((char)(0x80 | ((cp >> 6) & 0x3f)), stream) < 0)
-			return -ENOTRECOVERABLE;
-                if (fputc((char)(0x80 | (cp & 0x3f)), stream) < 0)
-			return -ENOTRECOVERABLE;
-		break;
-	default:
-		assert(0);
-	}
-
-	return 0;
+/*
+ * Reads the literal @literal at @json->p.
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_JSON if @json->p does not point to @literal
+ */
+static int c_json_read_literal(CJson *json, const char *literal) {
+        for (; *literal; literal += 1) {
+                if (current(json) != *literal)
+                        return C_JSON_E_INVALID_JSON;
+                json->p += 1;
+        }
+
+        return 0;
 }
 
-/**
- * c_json_new() - allocate and initialize a CJSon struct
- * @jsonp:              return location
- * @max_depth:          maximum nesting depth
+/*
+ * Writes @cp as UTF-8 to @p, which must have room for at least four
+ * bytes.
  *
- * Return: <0 on fatal failures
- *         0 on success
+ * Return: the number of bytes written
  */
-_c_public_ int c_json_new(CJson **jsonp, size_t max_depth) {
-        _c_cleanup_(c_json_freep) CJson *json = NULL;
+static size_t c_json_write_utf8(uint32_t cp, char *p) {
+        switch (cp) {
+                case  0x0000 ...   0x007F:
+                        p[0] = (char)cp;
+                        return 1;
+
+                case  0x0080 ...   0x07FF:
+                        p[0] = (char)(0xc0 | (cp >> 6));
+                        p[1] = (char)(0x80 | (cp & 0x3f));
+                        return 2;
+
+                case  0x0800 ...   0xFFFF:
+                        p[0] = (char)(0xe0 | (cp >> 12));
+                        p[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+                        p[2] = (char)(0x80 | (cp & 0x3f));
+                        return 3;
+
+                case 0x10000 ... 0x10FFFF:
+                        p[0] = (char)(0xf0 | (cp >> 18));
+                        p[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+                        p[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+                        p[3] = (char)(0x80 | (cp & 0x3f));
+                        return 4;
 
-        json = calloc(1, sizeof(*json) + max_depth + 1);
-        if (!json)
-                return -ENOMEM;
+                default:
+                        assert(0);
+                        return 0;
+        }
+}
 
-        json->n_states = max_depth;
+/*
+ * Makes sure that @json->buffer has room for at least @n bytes after
+ * the first @n_used ones.
+ */
+static int c_json_reserve(CJson *json, size_t n_used, size_t n) {
+        size_t n_buffer;
+        char *buffer;
 
-        *jsonp = json;
-        json = NULL;
+        if (_c_likely_(json->buffer && json->n_buffer - n_used >= n))
+                return 0;
 
-        return 0;
-}
+        n_buffer = c_max(json->n_buffer * 2, n_used + n);
+        if (n_buffer < 64)
+                n_buffer = 64;
 
-/**
- * c_json_free() - deinitialize and free a CJSon struct
- * @json:               json to free
- *
- * Return: NULL
- */
-_c_public_ CJson * c_json_free(CJson *json) {
-        free(json);
+        buffer = realloc(json->buffer, n_buffer);
+        if (!buffer)
+                return -ENOMEM;
 
-        return NULL;
+        c_json_stat(json, n_allocations, 1);
+        json->buffer = buffer;
+        json->n_buffer = n_buffer;
+
+        return 0;
 }
 
-/**
- * c_json_peek - peek at the next value
- * @json                json object
- *
- * Peeks at the next value in the input stream. Does not validate that
- * the next value is valid.
+/*
+ * Reads the escape sequence at @json->p, which must point behind the
+ * backslash, and writes the code point it encodes to @cpp.
  *
- * Return: -1 if the next token is invalid or when exiting a container
- *         one of the C_JSON_TYPE_ values
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_JSON if the escape sequence is malformed
  */
-_c_public_ int c_json_peek(CJson *json) {
-        if (_c_unlikely_(json->poison))
-                return -1;
+static int c_json_read_escape(CJson *json, uint32_t *cpp) {
+        uint16_t cu;
+        uint32_t cp;
+        int r;
 
-        switch (*json->p) {
-                case '[':
-                        return C_JSON_TYPE_ARRAY;
+        switch (current(json)) {
+                case '"':
+                        cp = '"';
+                        break;
 
-                case '{':
-                        return C_JSON_TYPE_OBJECT;
+                case '\\':
+                        cp = '\\';
+                        break;
 
-                case '"':
-                        return C_JSON_TYPE_STRING;
+                case '/':
+                        cp = '/';
+                        break;
 
-                case '0' ... '9':
-                case '-':
-                        return C_JSON_TYPE_NUMBER;
+                case 'b':
+                        cp = '\b';
+                        break;
 
-                case 't':
                 case 'f':
-                        return C_JSON_TYPE_BOOLEAN;
+                        cp = '\f';
+                        break;
 
                 case 'n':
-                        return C_JSON_TYPE_NULL;
+                        cp = '\n';
+                        break;
+
+                case 'r':
+                        cp = '\r';
+                        break;
+
+                case 't':
+                        cp = '\t';
+                        break;
+
+                case 'u':
+                        json->p += 1;
+                        r = c_json_read_utf16_unit(json, &cu);
+                        if (r)
+                                return r;
+
+                        switch (cu) {
+                                case 0xD800 ... 0xDBFF:
+                                        cp = 0x10000 + ((cu - 0xD800) << 10);
+
+                                        if (current(json) != '\\')
+                                                return C_JSON_E_INVALID_JSON;
+                                        json->p += 1;
+                                        if (current(json) != 'u')
+                                                return C_JSON_E_INVALID_JSON;
+                                        json->p += 1;
+
+                                        r = c_json_read_utf16_unit(json, &cu);
+                                        if (r)
+                                                return r;
+
+                                        if (cu < 0xDC00 || cu > 0xDFFF)
+                                                return C_JSON_E_INVALID_JSON;
+
+                                        cp += cu - 0xDC00;
+                                        break;
+
+                                case 0xDC00 ... 0xDFFF:
+                                        return C_JSON_E_INVALID_JSON;
+
+                                default:
+                                        cp = cu;
+                                        break;
+                        }
+
+                        *cpp = cp;
+                        return 0;
 
                 default:
-                case ']':
-                case '}':
-                        return -1;
+                        return C_JSON_E_INVALID_JSON;
         }
+
+        json->p += 1;
+        *cpp = cp;
+
+        return 0;
 }
 
-/**
- * c_json_begin_read() - begin readinh JSON from a string
- * @json                json object
- * @string              0-terminated string to read from
- *
- * It is an error to call this function multiple times without calling
- * c_json_end_read().
+/*
+ * Returns where the next @n decoded bytes of a string go, behind the
+ * @n_used that were decoded so far, or NULL if allocating them fails. In
+ * place, the decoded string overwrites its own escaped form starting at
+ * @base. It can never overtake the input, as no escape sequence decodes
+ * into more bytes than it spans.
  */
-_c_public_ void c_json_begin_read(CJson *json, const char *string) {
-        assert(!json->input);
+static char *c_json_decode_target(CJson *json, char *base, size_t n_used, size_t n) {
+        if (base)
+                return base + n_used;
 
-        json->input = string;
-        json->p = skip_space(json->input);
+        if (c_json_reserve(json, n_used, n))
+                return NULL;
+
+        return json->buffer + n_used;
 }
 
-/**
- * c_json_end_read() - end reading
- * @json                json object
+/*
+ * Reads the string at @json->p and leaves @json->p behind the closing
+ * quote. If the string does not contain any escape sequences, the
+ * returned slice points into the input. Otherwise, it is decoded into
+ * @json->buffer, or over the input in place, and the slice points
+ * there.
  *
  * Return: <0 on fatal error
  *         0 on success
- *         the last error that occured in a reader function
- *         C_JSON_E_INVALID_TYPE if called before the input was fully read
+ *         C_JSON_E_INVALID_TYPE if then next value is not a string
  *         C_JSON_E_INVALID_JSON if the JSON input is malformed
  */
-_c_public_ int c_json_end_read(CJson *json) {
-        int r = json->poison;
+static int c_json_scan_string(CJson *json, const char **stringp, size_t *np) {
+        const char *start;
+        char *base, *out;
+        size_t n_used = 0;
+        uint32_t cp;
+        int r;
+
+        if (current(json) != '"')
+                return C_JSON_E_INVALID_TYPE;
+
+        json->p += 1;
+        start = json->p;
+
+        json->p = c_json_string_run(json, json->p);
+        if (current(json) != '"' && current(json) != '\\')
+                return C_JSON_E_INVALID_JSON;
+
+        if (_c_likely_(current(json) == '"')) {
+                *stringp = start;
+                *np = json->p - start;
+                json->p += 1;
+                c_json_stat(json, n_strings_borrowed, 1);
+                return 0;
+        }
+
+        base = json->inplace ? (char *)start : NULL;
+
+        for (;;) {
+                out = c_json_decode_target(json, base, n_used, json->p - start);
+                if (!out)
+                        return -ENOMEM;
+
+                memmove(out, start, json->p - start);
+                n_used += json->p - start;
+
+                if (current(json) == '"')
+                        break;
+
+                json->p += 1; /* '\\' */
+                r = c_json_read_escape(json, &cp);
+                if (r)
+                        return r;
+
+                c_json_stat(json, n_escapes, 1);
+
+                out = c_json_decode_target(json, base, n_used, 4);
+                if (!out)
+                        return -ENOMEM;
+
+                n_used += c_json_write_utf8(cp, out);
+
+                start = json->p;
+                json->p = c_json_string_run(json, json->p);
+                if (current(json) != '"' && current(json) != '\\')
+                        return C_JSON_E_INVALID_JSON;
+        }
+
+        json->p += 1; /* '"' */
+
+        c_json_stat(json, n_strings_decoded, 1);
+
+        *stringp = base ? base : json->buffer;
+        *np = n_used;
+
+        return 0;
+}
+
+/*
+ * Skips the string at @json->p without decoding it, and leaves @json->p
+ * behind the closing quote. Escape sequences are still validated.
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ */
+static int c_json_skip_string(CJson *json) {
+        uint32_t cp;
+        int r;
+
+        json->p += 1; /* '"' */
+
+        for (;;) {
+                json->p = c_json_string_run(json, json->p);
+
+                switch (current(json)) {
+                        case '"':
+                                json->p += 1;
+                                return 0;
+
+                        case '\\':
+                                json->p += 1;
+                                r = c_json_read_escape(json, &cp);
+                                if (r)
+                                        return r;
+                                break;
+
+                        default:
+                                return C_JSON_E_INVALID_JSON;
+                }
+        }
+}
+
+/*
+ * Skips the string at @json->p like c_json_skip_string(), but only
+ * looks for the closing quote.
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_JSON if the string is not terminated
+ */
+static int c_json_skip_string_trusted(CJson *json) {
+        json->p += 1; /* '"' */
+
+        for (;;) {
+                json->p = c_json_string_run(json, json->p);
+                if (json->p >= json->end)
+                        return C_JSON_E_INVALID_JSON;
+
+                if (*json->p == '"') {
+                        json->p += 1;
+                        return 0;
+                }
+
+                /* jump over the escaped character, or a stray control character */
+                json->p = c_min(json->p + (*json->p == '\\' ? 2 : 1), json->end);
+        }
+}
+
+/*
+ * Skips the value at @json->p by only matching brackets and quotes,
+ * and leaves @json->p behind it. Nothing else is validated.
+ *
+ * Return: 0 on success
+ *         C_JSON_E_INVALID_JSON if the input ends within the value
+ */
+static int c_json_skip_value_trusted(CJson *json) {
+        size_t depth = 0;
+        int r;
+
+        switch (current(json)) {
+                case '"':
+                        return c_json_skip_string_trusted(json);
+
+                case '[':
+                case '{':
+                        break;
+
+                default:
+                        /* scalars run up to the next separator */
+                        while (json->p < json->end &&
+                               !is_space(*json->p) &&
+                               *json->p != ',' && *json->p != ']' && *json->p != '}' && *json->p != ':')
+                                json->p += 1;
+                        return 0;
+        }
+
+        for (;;) {
+                json->p = c_json_structure_run(json, json->p);
+
+                switch (current(json)) {
+                        case '"':
+                                r = c_json_skip_string_trusted(json);
+                                if (r)
+                                        return r;
+                                break;
+
+                        case '[':
+                        case '{':
+                                json->p += 1;
+                                depth += 1;
+                                break;
+
+                        case ']':
+                        case '}':
+                                json->p += 1;
+                                if (--depth == 0)
+                                        return 0;
+                                break;
+
+                        default:
+                                return C_JSON_E_INVALID_JSON;
+                }
+        }
+}
+
+/*
+ * Skips the value at @json->p, see c_json_skip(). Failures are already
+ * passed through c_json_fail().
+ */
+static int c_json_skip_value(CJson *json) {
+        size_t level = json->level;
+        int r;
+
+        if (current(json) == ']' || current(json) == '}')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        if (json->flags & C_JSON_FLAG_TRUSTED) {
+                r = c_json_skip_value_trusted(json);
+                if (r)
+                        return c_json_fail(json, r);
+
+                r = c_json_advance(json);
+                if (r)
+                        return r;
+
+                c_json_stat(json, n_skipped, 1);
+
+                return 0;
+        }
+
+        do {
+                switch (current(json)) {
+                        case '[':
+                        case '{':
+                                if (json->level >= json->n_states)
+                                        return c_json_fail(json, C_JSON_E_DEPTH_OVERFLOW);
+
+                                c_json_push(json, current(json));
+                                c_json_stat_max(json, max_depth, json->level);
+                                json->p = skip_space(json, json->p + 1);
+                                if (json->state == '{' && current(json) != '"' && current(json) != '}')
+                                        return c_json_fail(json, C_JSON_E_INVALID_JSON);
+                                continue;
+
+                        case ']':
+                                if (json->state != '[')
+                                        return c_json_fail(json, C_JSON_E_INVALID_JSON);
+                                json->p += 1;
+                                c_json_pop(json);
+                                break;
+
+                        case '}':
+                                if (json->state != '{' && json->state != '}')
+                                        return c_json_fail(json, C_JSON_E_INVALID_JSON);
+                                json->p += 1;
+                                c_json_pop(json);
+                                break;
+
+                        case '"':
+                                r = c_json_skip_string(json);
+                                if (r)
+                                        return c_json_fail(json, r);
+                                break;
+
+                        case '-':
+                        case '0' ... '9':
+                                r = c_json_skip_number(json->p, json->end, &json->p);
+                                if (r)
+                                        return c_json_fail(json, r);
+                                break;
+
+                        case 't':
+                                r = c_json_read_literal(json, "true");
+                                if (r)
+                                        return c_json_fail(json, r);
+                                break;
+
+                        case 'f':
+                                r = c_json_read_literal(json, "false");
+                                if (r)
+                                        return c_json_fail(json, r);
+                                break;
+
+                        case 'n':
+                                r = c_json_read_literal(json, "null");
+                                if (r)
+                                        return c_json_fail(json, r);
+                                break;
+
+                        default:
+                                return c_json_fail(json, C_JSON_E_INVALID_JSON);
+                }
+
+                r = c_json_advance(json);
+                if (r)
+                        return r;
+        } while (json->level > level);
+
+        c_json_stat(json, n_skipped, 1);
+
+        return 0;
+}
+
+/*
+ * Allocates @n bytes from the arena, asking the caller for another block
+ * if the current one is exhausted.
+ */
+static char *c_json_arena_alloc(CJson *json, size_t n) {
+        char *p;
+        size_t n_block;
+
+        if (_c_unlikely_(json->arena.n < n)) {
+                if (!json->arena.grow)
+                        return NULL;
+
+                p = json->arena.grow(json->arena.userdata, n, &n_block);
+                if (!p)
+                        return NULL;
+
+                c_json_stat(json, n_allocations, 1);
+
+                assert(n_block >= n);
+                json->arena.p = p;
+                json->arena.n = n_block;
+        }
+
+        p = json->arena.p;
+        json->arena.p += n;
+        json->arena.n -= n;
+
+        return p;
+}
+
+/**
+ * c_json_new() - allocate and initialize a CJSon struct
+ * @jsonp:              return location
+ * @max_depth:          maximum nesting depth
+ *
+ * Return: <0 on fatal failures
+ *         0 on success
+ */
+_c_public_ int c_json_new(CJson **jsonp, size_t max_depth) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+
+        json = calloc(1, sizeof(*json) + max_depth / 8 + 1);
+        if (!json)
+                return -ENOMEM;
+
+        json->n_states = max_depth;
+
+        *jsonp = json;
+        json = NULL;
+
+        return 0;
+}
+
+/**
+ * c_json_free() - deinitialize and free a CJSon struct
+ * @json:               json to free
+ *
+ * Return: NULL
+ */
+_c_public_ CJson * c_json_free(CJson *json) {
+        if (!json)
+                return NULL;
+
+        if (json->map.p)
+                munmap(json->map.p, json->map.n);
+        free(json->out);
+        free(json->index.positions);
+        free(json->feed);
+        free(json->buffer);
+        free(json);
+
+        return NULL;
+}
+
+/**
+ * c_json_set_flags() - change how input is read
+ * @json                json object
+ * @flags               C_JSON_FLAG_* values, or 0
+ *
+ * C_JSON_FLAG_TRUSTED: c_json_skip() only matches brackets and quotes,
+ * without validating what it skips. Use this only for input that is known
+ * to be valid JSON, as anything else leads to unspecified, though memory
+ * safe, results.
+ *
+ * C_JSON_FLAG_INDEX: c_json_begin_read() and c_json_begin_read_n() build
+ * an index of all structural characters of the input first, which the
+ * readers then use to find the ends of strings and containers without
+ * scanning the bytes in between. Building it takes a pass over all of the
+ * input at about the speed at which the scanners cross long strings, so
+ * reading or validating documents with long strings gets slower with it.
+ * It only pays off where readers would otherwise stop often, like when
+ * skipping pretty-printed input with short strings and
+ * C_JSON_FLAG_TRUSTED. The index needs up to four bytes per structural
+ * character, and if it cannot be allocated, the first reader fails with
+ * -ENOMEM. Input that is fed incrementally is never indexed.
+ *
+ * C_JSON_FLAG_UTF8: strings, including keys and those that are skipped,
+ * must be well-formed UTF-8, and readers fail with C_JSON_E_INVALID_JSON
+ * otherwise. Escape sequences always decode to valid UTF-8, so strings
+ * that are read are known to be valid without another pass over them.
+ * The scan for the end of a string stops at the first non-ASCII byte,
+ * hence this costs nothing for strings that are pure ASCII. Like
+ * everything else, strings are not validated with C_JSON_FLAG_TRUSTED.
+ */
+_c_public_ void c_json_set_flags(CJson *json, unsigned int flags) {
+        json->flags = flags;
+}
+
+/**
+ * c_json_peek - peek at the next value
+ * @json                json object
+ *
+ * Peeks at the next value in the input stream. Does not validate that
+ * the next value is valid.
+ *
+ * Return: -1 if the next token is invalid or when exiting a container
+ *         one of the C_JSON_TYPE_ values
+ */
+_c_public_ int c_json_peek(CJson *json) {
+        if (_c_unlikely_(json->poison))
+                return -1;
+
+        switch (current(json)) {
+                case '[':
+                        return C_JSON_TYPE_ARRAY;
+
+                case '{':
+                        return C_JSON_TYPE_OBJECT;
+
+                case '"':
+                        return C_JSON_TYPE_STRING;
+
+                case '0' ... '9':
+                case '-':
+                        return C_JSON_TYPE_NUMBER;
+
+                case 't':
+                case 'f':
+                        return C_JSON_TYPE_BOOLEAN;
+
+                case 'n':
+                        return C_JSON_TYPE_NULL;
+
+                default:
+                case ']':
+                case '}':
+                        return -1;
+        }
+}
+
+/**
+ * c_json_begin_read() - begin readinh JSON from a string
+ * @json                json object
+ * @string              0-terminated string to read from
+ *
+ * It is an error to call this function multiple times without calling
+ * c_json_end_read().
+ */
+_c_public_ void c_json_begin_read(CJson *json, const char *string) {
+        c_json_begin_read_n(json, string, strlen(string));
+}
+
+/**
+ * c_json_begin_read_n() - begin reading JSON from a buffer
+ * @json                json object
+ * @data                buffer to read from
+ * @n_data              length of @data
+ *
+ * Like c_json_begin_read(), but reads exactly @n_data bytes, which do
+ * not need to be followed by a 0-terminator. The buffer is not copied,
+ * so it must stay valid and unmodified until c_json_end_read().
+ *
+ * It is an error to call this function multiple times without calling
+ * c_json_end_read().
+ */
+_c_public_ void c_json_begin_read_n(CJson *json, const void *data, size_t n_data) {
+        int r;
+
+        assert(!json->input && !json->writing);
+
+        c_json_clear_stats(json);
+
+        json->input = data;
+        json->end = json->input + n_data;
+        json->p = skip_space(json, json->input);
+
+        if (json->flags & C_JSON_FLAG_INDEX) {
+                r = c_json_index_build(json);
+                if (r)
+                        json->poison = r;
+        }
+}
+
+/**
+ * c_json_begin_read_inplace() - begin reading JSON from a writable buffer
+ * @json                json object
+ * @data                buffer to read from
+ * @n_data              length of @data
+ *
+ * Like c_json_begin_read_n(), but strings are decoded within @data, so
+ * reading them never allocates. c_json_read_string() returns strings that
+ * point into @data and are 0-terminated in place, and must not be freed.
+ * They stay valid as long as @data does, even after c_json_end_read().
+ * The contents of @data beyond those strings are unspecified afterwards.
+ *
+ * It is an error to call this function multiple times without calling
+ * c_json_end_read().
+ */
+_c_public_ void c_json_begin_read_inplace(CJson *json, char *data, size_t n_data) {
+        c_json_begin_read_n(json, data, n_data);
+        json->inplace = true;
+}
+
+/**
+ * c_json_begin_read_file() - begin reading JSON from a file
+ * @json                json object
+ * @fd                  file descriptor of a regular file
+ *
+ * Maps the file that @fd refers to into memory and reads it like
+ * c_json_begin_read_n() does, so it is neither copied nor read into a
+ * buffer first. The kernel is told that the mapping is read sequentially,
+ * and to back it with huge pages where it supports that. The mapping is
+ * released by c_json_end_read(), which also invalidates all strings
+ * returned by c_json_read_string_view(). @fd is not needed after this
+ * returns and may be closed.
+ *
+ * The file must not be truncated while it is read, as accessing pages
+ * behind its new end raises SIGBUS. Pipes, sockets and terminals cannot
+ * be mapped and have to be read with c_json_begin_feed() instead.
+ *
+ * If this fails, reading has not begun.
+ *
+ * It is an error to call this function multiple times without calling
+ * c_json_end_read().
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         -ENODEV if @fd does not refer to a regular file
+ *         -EFBIG if the file does not fit into the address space
+ */
+_c_public_ int c_json_begin_read_file(CJson *json, int fd) {
+        struct stat st;
+        void *p;
+
+        assert(!json->input && !json->writing);
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (!S_ISREG(st.st_mode))
+                return -ENODEV;
+        if ((uintmax_t)st.st_size > SIZE_MAX)
+                return -EFBIG;
+
+        /* an empty mapping is invalid */
+        if (st.st_size == 0) {
+                c_json_begin_read_n(json, "", 0);
+                return 0;
+        }
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        /* both are merely hints */
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        madvise(p, st.st_size, MADV_HUGEPAGE);
+#endif
+
+        json->map.p = p;
+        json->map.n = st.st_size;
+        c_json_begin_read_n(json, p, st.st_size);
+
+        return 0;
+}
+
+/**
+ * c_json_get_input() - get the input that is read
+ * @json                json object
+ * @np                  return location for the length of the input
+ *
+ * Returns the whole input that reading began with, regardless of how far
+ * it has been read. For c_json_begin_read_file(), this is the mapping of
+ * the file, which lets it be shared with other readers, like threads that
+ * each read a part of it. It stays valid until c_json_end_read().
+ *
+ * Return: the input, or NULL if @json is not reading, or reads input that
+ *         is fed incrementally
+ */
+_c_public_ const char * c_json_get_input(CJson *json, size_t *np) {
+        if (!json->input || json->feeding)
+                return NULL;
+
+        *np = json->end - json->input;
+
+        return json->input;
+}
+
+/**
+ * c_json_end_read() - end reading
+ * @json                json object
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if called before the input was fully read
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ */
+_c_public_ int c_json_end_read(CJson *json) {
+        int r = json->poison;
+
+        if (!r) {
+                if (json->level > 0)
+                        r = C_JSON_E_INVALID_TYPE;
+
+                if (json->level == 0 && json->p != json->end)
+                        r = C_JSON_E_INVALID_JSON;
+        }
+
+        c_json_stat(json, n_bytes, json->p - json->input);
+
+        json->level = 0;
+        json->state = 0;
+        json->adjacent = false;
+        json->input = NULL;
+        json->p = NULL;
+        json->end = NULL;
+        json->n_feed = 0;
+        json->feeding = false;
+        json->final = false;
+        json->inplace = false;
+        json->indexed = false;
+        json->arena.p = json->arena.buffer;
+        json->arena.n = json->arena.n_buffer;
+
+        if (json->map.p) {
+                munmap(json->map.p, json->map.n);
+                json->map.p = NULL;
+                json->map.n = 0;
+        }
+
+        return r;
+}
+
+/**
+ * c_json_next_document() - move on to the next document
+ * @json                json object
+ * @morep               return location for whether another document follows
+ *
+ * Reads multiple documents from one input, such as newline-delimited JSON
+ * or documents that are simply concatenated. Call this before each
+ * document, including the first. If *@morep is set to true, the next
+ * document can be read, otherwise the input is exhausted and reading can
+ * be ended with c_json_end_read().
+ *
+ * Documents may be separated by any whitespace. Arrays and objects need
+ * no separator before or behind them, but any other document must be
+ * followed by whitespace, unless the next one is an array or object, so
+ * `[1][2]` and `1[2]` are two documents each, while `1-2` and `truefalse`
+ * are invalid. Strings that were allocated from the arena become invalid,
+ * as the arena is rewound for the next document.
+ *
+ * In feed mode, this returns C_JSON_E_AGAIN if it cannot tell yet whether
+ * another document follows.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if the current document is not complete
+ *         C_JSON_E_INVALID_JSON if the next document is not separated from
+ *         the current one
+ */
+_c_public_ int c_json_next_document(CJson *json, bool *morep) {
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        if (json->level > 0)
+                return (json->poison = C_JSON_E_INVALID_TYPE);
+
+        json->p = skip_space(json, json->p);
+        if (c_json_starved(json))
+                return C_JSON_E_AGAIN;
+
+        if (json->adjacent && json->p < json->end && current(json) != '[' && current(json) != '{')
+                return (json->poison = C_JSON_E_INVALID_JSON);
+
+        json->arena.p = json->arena.buffer;
+        json->arena.n = json->arena.n_buffer;
+
+        *morep = json->p < json->end;
+
+        return 0;
+}
+
+/**
+ * c_json_set_arena() - allocate strings from an arena
+ * @json                json object
+ * @buffer              initial block of the arena, or NULL
+ * @n_buffer            size of @buffer
+ * @grow                callback that provides further blocks, or NULL
+ * @userdata            argument passed to @grow
+ *
+ * Makes c_json_read_string() allocate strings from @buffer instead of
+ * the heap. Such strings must not be freed. All of them are released at
+ * once by c_json_end_read() or c_json_reset(), which rewind the arena to
+ * the start of @buffer, and become invalid then.
+ *
+ * Once @buffer is exhausted, @grow is called with the number of bytes
+ * needed and must return a block of at least that size, writing its
+ * actual size to its last argument. Strings are then allocated from that
+ * block. The library never frees blocks, so the caller decides how long
+ * they live. Usually, they are kept for the next document, or released
+ * together with the request they belong to. If @grow is NULL or returns
+ * NULL, reading a string fails with -ENOMEM.
+ *
+ * Passing NULL for @buffer and @grow switches back to heap allocation.
+ * It is an error to call this function while reading.
+ */
+_c_public_ void c_json_set_arena(CJson *json,
+                                 void *buffer,
+                                 size_t n_buffer,
+                                 CJsonArenaGrowFn grow,
+                                 void *userdata) {
+        assert(!json->input);
+
+        json->arena.buffer = buffer;
+        json->arena.n_buffer = buffer ? n_buffer : 0;
+        json->arena.p = json->arena.buffer;
+        json->arena.n = json->arena.n_buffer;
+        json->arena.grow = grow;
+        json->arena.userdata = userdata;
+}
+
+/**
+ * c_json_set_symbols() - intern the keys read by c_json_read_key()
+ * @json                json object
+ * @symbols             symbol table, or NULL
+ *
+ * @symbols is not owned by @json, and must outlive it or be unset first.
+ * Unless it is frozen, see c_json_symbols_freeze(), it must not be set on
+ * any other reader that is used concurrently.
+ */
+_c_public_ void c_json_set_symbols(CJson *json, CJsonSymbols *symbols) {
+        json->symbols = symbols;
+}
+
+/**
+ * c_json_reset() - reset a json object for reuse
+ * @json                json object
+ *
+ * Ends the current read, if any, and clears the last error, so that @json
+ * can be reused as if it had just been created. The flags and the maximum
+ * depth are kept, as are internal buffers, so reading the next document
+ * does not need to allocate. Unlike c_json_end_read(), this may be called
+ * at any time. A document that is being written is discarded.
+ */
+_c_public_ void c_json_reset(CJson *json) {
+        c_json_end_read(json);
+        c_json_stop_write(json);
+        json->poison = 0;
+}
+
+/**
+ * c_json_get_stats() - retrieve the counters of the current read
+ * @json                json object
+ * @statsp              return location for the counters
+ *
+ * Returns what the readers did since reading began, or, after reading
+ * ended, for the whole last read. The counters are cleared when the next
+ * read begins.
+ *
+ * @n_bytes counts the input consumed, @n_values the values read by type,
+ * with the elements of c_json_read_*_array() counted one by one, and
+ * @n_skipped the values skipped by c_json_skip() and c_json_find_key*(),
+ * whose contents are not counted otherwise. Of the strings read,
+ * @n_strings_borrowed were copied verbatim from the input and
+ * @n_strings_decoded contained any of the @n_escapes escape sequences.
+ * Keys count as strings as well. @n_space counts bytes of whitespace,
+ * @n_allocations the buffers allocated or grown, and @max_depth the
+ * deepest nesting reached. @ns_strings and @ns_numbers are the total
+ * time spent decoding strings and numbers, which adds two clock reads
+ * to every value. In feed mode, work that is retried after
+ * C_JSON_E_AGAIN is counted again, except for @n_bytes, @n_values and
+ * @n_skipped.
+ *
+ * The counters are only kept if the library was built with the stats
+ * option, as they slow down every reader. Otherwise *@statsp is zeroed.
+ *
+ * Return: 0 on success
+ *         -ENOTSUP if the library was built without counters
+ */
+_c_public_ int c_json_get_stats(CJson *json, CJsonStats *statsp) {
+#if defined(C_JSON_STATS) && C_JSON_STATS
+        *statsp = json->stats;
+        statsp->n_bytes += json->p - json->input;
+
+        return 0;
+#else
+        (void)json;
+        *statsp = (CJsonStats){};
+
+        return -ENOTSUP;
+#endif
+}
+
+/**
+ * c_json_begin_feed() - begin reading JSON incrementally
+ * @json                json object
+ *
+ * Starts reading input that is passed in chunks via c_json_feed(), which
+ * must be called at least once before anything can be read. Whenever a
+ * reader function needs more input than was fed so far, it returns
+ * C_JSON_E_AGAIN without changing any state, and can be called again
+ * after the next chunk was fed.
+ *
+ * It is an error to call this function multiple times without calling
+ * c_json_end_read().
+ */
+_c_public_ void c_json_begin_feed(CJson *json) {
+        assert(!json->input && !json->writing);
+
+        c_json_clear_stats(json);
+
+        json->input = "";
+        json->p = json->input;
+        json->end = json->input;
+        json->n_feed = 0;
+        json->feeding = true;
+        json->final = false;
+}
+
+/**
+ * c_json_feed() - feed the next chunk of input
+ * @json                json object
+ * @data                next chunk of input
+ * @n_data              length of @data, or 0 to signal the end of input
+ *
+ * Appends @data to the input buffered in @json. Input that has already
+ * been read is discarded, so strings returned by
+ * c_json_read_string_view() become invalid.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         C_JSON_E_AGAIN if the buffered input does not contain the start
+ *         of the next value yet, so c_json_peek() and c_json_more()
+ *         cannot tell anything about it
+ */
+_c_public_ int c_json_feed(CJson *json, const void *data, size_t n_data) {
+        size_t n_consumed = 0;
+
+        assert(json->feeding && !json->final);
+
+        if (n_data == 0) {
+                json->final = true;
+                return 0;
+        }
+
+        if (json->input == json->feed)
+                n_consumed = json->p - json->feed;
+
+        if (n_consumed > 0) {
+                c_json_stat(json, n_bytes, n_consumed);
+                json->n_feed -= n_consumed;
+                memmove(json->feed, json->p, json->n_feed);
+        }
+
+        if (json->z_feed - json->n_feed < n_data) {
+                size_t z_feed = c_max(json->z_feed * 2, json->n_feed + n_data);
+                char *feed;
+
+                feed = realloc(json->feed, z_feed);
+                if (!feed)
+                        return (json->poison = -ENOMEM);
+
+                c_json_stat(json, n_allocations, 1);
+
+                json->feed = feed;
+                json->z_feed = z_feed;
+        }
+
+        memcpy(json->feed + json->n_feed, data, n_data);
+        json->n_feed += n_data;
+
+        json->input = json->feed;
+        json->end = json->feed + json->n_feed;
+        json->p = skip_space(json, json->feed);
+
+        return json->p == json->end ? C_JSON_E_AGAIN : 0;
+}
+
+/**
+ * c_json_read_null() - read `null` value
+ * @json                json object
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if then next value is not `null`
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ */
+_c_public_ int c_json_read_null(CJson *json) {
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        c_json_mark(json);
+
+        if (json->state == '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        switch (current(json)) {
+                case 'n':
+                        r = c_json_read_literal(json, "null");
+                        if (r)
+                                return c_json_fail(json, r);
+                        break;
+
+                default:
+                        return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+        }
+
+        r = c_json_advance(json);
+        if (r)
+                return r;
+
+        c_json_stat(json, n_values[C_JSON_TYPE_NULL], 1);
+
+        return 0;
+}
+
+/**
+ * c_json_read_string() - read a string
+ * @json                json object
+ * @srtringp            return location for the string
+ *
+ * The returned string must be freed, unless an arena is set, see
+ * c_json_set_arena(), or the input is read in place, see
+ * c_json_begin_read_inplace().
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if then next value is not a string
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ */
+_c_public_ int c_json_read_string(CJson *json, char **stringp) {
+        const char *string;
+        size_t n;
+        int r;
+
+        r = c_json_read_string_view(json, &string, &n);
+        if (r)
+                return r;
+
+        if (stringp && json->inplace) {
+                /* this only overwrites the closing quote, or what is behind it */
+                *stringp = (char *)string;
+                (*stringp)[n] = '\0';
+        } else if (stringp) {
+                if (json->arena.buffer || json->arena.grow)
+                        *stringp = c_json_arena_alloc(json, n + 1);
+                else
+                        *stringp = malloc(n + 1);
+                if (!*stringp)
+                        return c_json_fail(json, -ENOMEM);
+
+                c_json_stat(json, n_allocations, !json->arena.buffer && !json->arena.grow);
+
+                memcpy(*stringp, string, n);
+                (*stringp)[n] = '\0';
+        }
+
+        return 0;
+}
+
+/**
+ * c_json_read_string_view() - read a string without copying it
+ * @json                json object
+ * @stringp             return location for the string
+ * @np                  return location for the length of the string
+ *
+ * If the string does not contain escape sequences, the returned string
+ * points into the input. Otherwise, it is decoded into a buffer owned
+ * by @json. In both cases it is not 0-terminated and only valid until
+ * the next call to any function on @json.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if then next value is not a string
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ */
+_c_public_ int c_json_read_string_view(CJson *json, const char **stringp, size_t *np) {
+        uint64_t start = c_json_stat_now();
+        const char *string;
+        size_t n;
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        c_json_mark(json);
+
+        r = c_json_scan_string(json, &string, &n);
+        c_json_stat(json, ns_strings, c_json_stat_now() - start);
+        if (r)
+                return c_json_fail(json, r);
+
+        r = c_json_advance(json);
+        if (r)
+                return r;
+
+        c_json_stat(json, n_values[C_JSON_TYPE_STRING], 1);
+
+        if (stringp)
+                *stringp = string;
+        if (np)
+                *np = n;
+
+        return 0;
+}
+
+/**
+ * c_json_read_key() - read an object key and intern it
+ * @json                json object
+ * @keyp                return location for the key, or NULL
+ * @idp                 return location for the ID of the key, or NULL
+ *
+ * Reads the next key of the current object, and resolves it through the
+ * symbol table of @json, see c_json_set_symbols(), which must be set. Keys
+ * that are not part of the table yet are added to it, unless it is frozen
+ * or full. The next value is the value of the key.
+ *
+ * *@keyp points to the 0-terminated copy of the key owned by the table,
+ * or is set to NULL, and *@idp to C_JSON_KEY_NONE, if the key could not
+ * be added. Looking up a key that is part of the table does not allocate.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if not in front of a key
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ */
+_c_public_ int c_json_read_key(CJson *json, const char **keyp, size_t *idp) {
+        const char *key;
+        size_t n_key, id;
+        int r;
+
+        assert(json->symbols);
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        c_json_mark(json);
+
+        if (json->state != '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        r = c_json_scan_string(json, &key, &n_key);
+        if (r)
+                return c_json_fail(json, r);
+
+        /* interning twice is harmless, if this is retried in feed mode */
+        r = c_json_symbols_intern(json->symbols, key, n_key, &id);
+        if (r)
+                return c_json_fail(json, r);
+
+        r = c_json_advance(json);
+        if (r)
+                return r;
+
+        c_json_stat(json, n_values[C_JSON_TYPE_STRING], 1);
+
+        if (keyp)
+                *keyp = id == C_JSON_KEY_NONE ? NULL : c_json_symbols_get(json->symbols, id, NULL);
+        if (idp)
+                *idp = id;
+
+        return 0;
+}
+
+/**
+ * c_json_read_u64() - read a unsigned integer
+ * @json                json object
+ * @srtringp            return location for the integer
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if then next value is not an unsigned integer
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_OUT_OF_RANGE if the integer does not fit into 64 bits
+ */
+_c_public_ int c_json_read_u64(CJson *json, uint64_t *numberp) {
+        uint64_t start = c_json_stat_now();
+        const char *end;
+        uint64_t number;
+        bool negative;
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
+
+        c_json_mark(json);
+
+        if (json->state == '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        if (current(json) < '0' || current(json) > '9')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        r = c_json_parse_integer(json->p, json->end, &negative, &number, &end);
+        c_json_stat(json, ns_numbers, c_json_stat_now() - start);
+        if (r) {
+                json->p = end;
+                return c_json_fail(json, r);
+        }
+
+        json->p = end;
+
+        r = c_json_advance(json);
+        if (r)
+                return r;
+
+        c_json_stat(json, n_values[C_JSON_TYPE_NUMBER], 1);
+
+        if (numberp)
+                *numberp = number;
+
+        return 0;
+}
+
+/**
+ * c_json_read_i64() - read a signed integer
+ * @json                json object
+ * @numberp             return location for the integer
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if then next value is not an integer
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_OUT_OF_RANGE if the integer does not fit into 64 bits
+ */
+_c_public_ int c_json_read_i64(CJson *json, int64_t *numberp) {
+        uint64_t start = c_json_stat_now();
+        const char *end;
+        uint64_t magnitude;
+        bool negative;
+        int64_t number;
+        int r;
+
+        if (_c_unlikely_(json->poison))
+                return json->poison;
 
-        if (!r) {
-                if (json->level > 0)
-                        r = C_JSON_E_INVALID_TYPE;
+        c_json_mark(json);
 
-                if (json->level == 0 && *json->p != '\0')
-                        r = C_JSON_E_INVALID_JSON;
+        if (json->state == '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        if (current(json) != '-' && (current(json) < '0' || current(json) > '9'))
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        r = c_json_parse_integer(json->p, json->end, &negative, &magnitude, &end);
+        c_json_stat(json, ns_numbers, c_json_stat_now() - start);
+        if (r) {
+                json->p = end;
+                return c_json_fail(json, r);
         }
 
-        json->level = 0;
-        json->input = NULL;
-        json->p = NULL;
+        if (negative) {
+                if (magnitude > (uint64_t)INT64_MAX + 1)
+                        return c_json_fail(json, C_JSON_E_OUT_OF_RANGE);
+                number = (int64_t)(0 - magnitude);
+        } else {
+                if (magnitude > INT64_MAX)
+                        return c_json_fail(json, C_JSON_E_OUT_OF_RANGE);
+                number = (int64_t)magnitude;
+        }
 
-        return r;
+        json->p = end;
+
+        r = c_json_advance(json);
+        if (r)
+                return r;
+
+        c_json_stat(json, n_values[C_JSON_TYPE_NUMBER], 1);
+
+        if (numberp)
+                *numberp = number;
+
+        return 0;
 }
 
 /**
- * c_json_read_null() - read `null` value
+ * c_json_read_f64() - read a number
  * @json                json object
+ * @srtringp            return location for the number
  *
  * Return: <0 on fatal error
  *         0 on success
  *         the last error that occured in a reader function
- *         C_JSON_E_INVALID_TYPE if then next value is not `null`
+ *         C_JSON_E_INVALID_TYPE if then next value is not a number
  *         C_JSON_E_INVALID_JSON if the JSON input is malformed
  */
-_c_public_ int c_json_read_null(CJson *json) {
+_c_public_ int c_json_read_f64(CJson *json, double *numberp) {
+        uint64_t start = c_json_stat_now();
+        CJsonNumber number;
+        double f64;
+        int r;
+
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (json->states[json->level] == '{')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        c_json_mark(json);
 
-        switch (*json->p) {
-                case 'n':
-                        if (strncmp(json->p, "null", strlen("null")))
-                                return (json->poison = C_JSON_E_INVALID_JSON);
-                        json->p += strlen("null");
-                        break;
+        if (json->state == '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
 
-                default:
-                        return (json->poison = C_JSON_E_INVALID_TYPE);
+        if (current(json) != '-' && (current(json) < '0' || current(json) > '9'))
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        r = c_json_parse_number(json->p, json->end, &number);
+        if (r) {
+                json->p = number.end;
+                return c_json_fail(json, r);
         }
 
-        return c_json_advance(json);
+        r = c_json_number_to_f64(&number, json->p, &f64);
+        c_json_stat(json, ns_numbers, c_json_stat_now() - start);
+        if (r)
+                return c_json_fail(json, r);
+
+        json->p = number.end;
+
+        r = c_json_advance(json);
+        if (r)
+                return r;
+
+        c_json_stat(json, n_values[C_JSON_TYPE_NUMBER], 1);
+
+        if (numberp)
+                *numberp = f64;
+
+        return 0;
 }
 
 /**
- * c_json_read_string() - read a string
+ * c_json_read_bool() - read a boolean
  * @json                json object
- * @srtringp            return location for the string
- *
- * The returned string must be freed.
+ * @srtringp            return location for the boolean
  *
  * Return: <0 on fatal error
  *         0 on success
  *         the last error that occured in a reader function
- *         C_JSON_E_INVALID_TYPE if then next value is not a string
+ *         C_JSON_E_INVALID_TYPE if then next value is not a boolean
  *         C_JSON_E_INVALID_JSON if the JSON input is malformed
  */
-_c_public_ int c_json_read_string(CJson *json, char **stringp) {
-        _c_cleanup_(c_fclosep) FILE *stream = NULL;
-        _c_cleanup_(c_freep) char *string = NULL;
-        size_t size;
+_c_public_ int c_json_read_bool(CJson *json, bool *boolp) {
+        bool b;
         int r;
 
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (*json->p != '"')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
-
-        stream = open_memstream(&string, &size);
-        if (!stream)
-                return (json->poison = -ENOTRECOVERABLE);
+        c_json_mark(json);
 
-        json->p += 1;
-        while (*json->p != '"') {
-                if ((uint8_t)*json->p < 0x20)
-                        return (json->poison = C_JSON_E_INVALID_JSON);
+        if (json->state == '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
 
-		if (*json->p == '\\') {
-                        json->p += 1;
-                        switch (*json->p) {
-                                case '"':
-					json->p += 1;
-                                        if (fputc('"', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+        switch (current(json)) {
+                case 't':
+                        r = c_json_read_literal(json, "true");
+                        if (r)
+                                return c_json_fail(json, r);
+                        b = true;
+                        break;
 
-                                case '\\':
-					json->p += 1;
-                                        if (fputc('\\', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+                case 'f':
+                        r = c_json_read_literal(json, "false");
+                        if (r)
+                                return c_json_fail(json, r);
+                        b = false;
+                        break;
 
-                                case '/':
-					json->p += 1;
-                                        if (fputc('/', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+                default:
+                        return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+        }
 
-                                case 'b':
-					json->p += 1;
-                                        if (fputc('\b', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+        r = c_json_advance(json);
+        if (r)
+                return r;
 
-                                case 'f':
-					json->p += 1;
-                                        if (fputc('\f', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+        c_json_stat(json, n_values[C_JSON_TYPE_BOOLEAN], 1);
 
-                                case 'n':
-					json->p += 1;
-                                        if (fputc('\n', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+        if (boolp)
+                *boolp = b;
 
-                                case 'r':
-					json->p += 1;
-                                        if (fputc('\r', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+        return 0;
+}
 
-                                case 't':
-					json->p += 1;
-                                        if (fputc('\t', stream) < 0)
-                                                return (json->poison = -ENOTRECOVERABLE);
-                                        break;
+/*
+ * Reads numbers from the current array into @values, with the separators
+ * handled inline instead of by c_json_advance(). In feed mode, elements
+ * are read one by one, so each of them is committed on its own.
+ */
+static int c_json_read_numbers(CJson *json, bool integer, void *values, size_t n_max, size_t *np) {
+        const char *p = json->p, *end = json->end, *next;
+        uint64_t start = c_json_stat_now();
+        char state = json->state, c;
+        CJsonNumber number;
+        uint64_t magnitude;
+        bool negative;
+        size_t i = 0;
+        int r = 0;
 
-                                case 'u': {
-					uint16_t cu;
-					uint32_t cp;
-                                        int r;
+        if (_c_unlikely_(json->poison))
+                return json->poison;
 
-					json->p += 1;
+        if (_c_unlikely_(json->feeding)) {
+                for (; i < n_max && c_json_more(json); i += 1) {
+                        if (integer)
+                                r = c_json_read_u64(json, (uint64_t *)values + i);
+                        else
+                                r = c_json_read_f64(json, (double *)values + i);
+                        if (r)
+                                break;
+                }
 
-                                        r = c_json_read_utf16_unit(json->p, &cu);
-                                        if (r)
-                                                return (json->poison = r);
-                                        json->p += 4;
+                if (np)
+                        *np = i;
 
-					switch (cu) {
-					case 0xD800 ... 0xDBFF:
-						cp = 0x10000 + ((cu - 0xD800) << 10);
+                /* whatever was read is kept, the rest is retried */
+                return (r == C_JSON_E_AGAIN && i > 0) ? 0 : r;
+        }
 
-						if (json->p[0] != '\\' || json->p[1] != 'u')
-							return (json->poison = C_JSON_E_INVALID_JSON);
-						json->p +=2;
+        if (state != '[' && state != ',')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
 
-						r = c_json_read_utf16_unit(json->p, &cu);
-						if (r)
-							return (json->poison = r);
-						json->p += 4;
+        while (i < n_max) {
+                c = c_json_char(p, end);
+                if (c == ']' && state == '[')
+                        break;
 
-						if (cu < 0xDC00 || cu > 0xDFFF)
-							return (json->poison = C_JSON_E_INVALID_JSON);
+                if (integer) {
+                        if (c < '0' || c > '9') {
+                                r = C_JSON_E_INVALID_TYPE;
+                                break;
+                        }
 
-						cp += cu - 0xDC00;
+                        r = c_json_parse_integer(p, end, &negative, &magnitude, &next);
+                        if (r) {
+                                p = next;
+                                break;
+                        }
 
-						break;
-					case 0xDC00 ... 0xDFFF:
-						return (json->poison = C_JSON_E_INVALID_JSON);
-					default:
-						cp = cu;
-						break;
-					}
+                        ((uint64_t *)values)[i] = magnitude;
+                } else {
+                        if (c != '-' && (c < '0' || c > '9')) {
+                                r = C_JSON_E_INVALID_TYPE;
+                                break;
+                        }
 
-					r = c_json_write_utf8(cp, stream);
-					if (r)
-						return (json->poison = r);
+                        r = c_json_parse_number(p, end, &number);
+                        if (r) {
+                                p = number.end;
+                                break;
+                        }
 
-                                        break;
-                                }
+                        r = c_json_number_to_f64(&number, p, (double *)values + i);
+                        if (r)
+                                break;
 
-                                default:
-                                        return (json->poison = C_JSON_E_INVALID_JSON);
-                        }
+                        next = number.end;
+                }
 
+                p = skip_space(json, next);
+                c = c_json_char(p, end);
+                if (c == ',') {
+                        state = ',';
+                        p = skip_space(json, p + 1);
+                } else if (c == ']') {
+                        state = '[';
                 } else {
-			if (fputc(*json->p, stream) < 0)
-				return (json->poison = -ENOTRECOVERABLE);
-			json->p += 1;
-		}
+                        r = C_JSON_E_INVALID_JSON;
+                        break;
+                }
+
+                i += 1;
         }
 
-        json->p += 1; /* '"' */
+        json->p = p;
+        json->state = state;
 
-        stream = c_fclose(stream);
+        c_json_stat(json, ns_numbers, c_json_stat_now() - start);
+        c_json_stat(json, n_values[C_JSON_TYPE_NUMBER], i);
 
-        r = c_json_advance(json);
-        if (r)
-                return r;
+        if (np)
+                *np = i;
 
-        if (stringp) {
-                *stringp = string;
-                string = NULL;
-        }
+        return r ? (json->poison = r) : 0;
+}
 
-        return 0;
+/**
+ * c_json_read_u64_array() - read unsigned integers from an array
+ * @json                json object
+ * @values              output array
+ * @n_max               number of elements of @values
+ * @np                  return location for the number of integers read
+ *
+ * Reads up to @n_max unsigned integers from the current array, as if by
+ * repeated calls to c_json_read_u64(), but without the overhead of a call
+ * per element. Fewer are read if the array ends, or in feed mode, if the
+ * input fed so far ends. The array itself is not closed, so a large array
+ * can be read in chunks until c_json_more() returns false, and then
+ * closed with c_json_close_array().
+ *
+ * If an error occurs, *@np is set to the number of integers read before.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if not in an array, or an element is not
+ *         an unsigned integer
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_OUT_OF_RANGE if an integer does not fit into 64 bits
+ */
+_c_public_ int c_json_read_u64_array(CJson *json, uint64_t *values, size_t n_max, size_t *np) {
+        return c_json_read_numbers(json, true, values, n_max, np);
 }
 
 /**
- * c_json_read_u64() - read a unsigned integer
+ * c_json_read_f64_array() - read numbers from an array
  * @json                json object
- * @srtringp            return location for the integer
+ * @values              output array
+ * @n_max               number of elements of @values
+ * @np                  return location for the number of numbers read
+ *
+ * Reads up to @n_max numbers from the current array, as if by repeated
+ * calls to c_json_read_f64(). See c_json_read_u64_array().
  *
  * Return: <0 on fatal error
  *         0 on success
  *         the last error that occured in a reader function
- *         C_JSON_E_INVALID_TYPE if then next value is not an unsigned integer
+ *         C_JSON_E_INVALID_TYPE if not in an array, or an element is not
+ *         a number
  *         C_JSON_E_INVALID_JSON if the JSON input is malformed
  */
-_c_public_ int c_json_read_u64(CJson *json, uint64_t *numberp) {
-        char *end;
-        uint64_t number;
-        int r;
+_c_public_ int c_json_read_f64_array(CJson *json, double *values, size_t n_max, size_t *np) {
+        return c_json_read_numbers(json, false, values, n_max, np);
+}
 
+/**
+ * c_json_skip() - skip the next value
+ * @json                json object
+ *
+ * Skips the next value, and everything nested in it, without decoding
+ * it: no string is copied and no number is converted. The skipped input
+ * is still validated, unless C_JSON_FLAG_TRUSTED is set.
+ *
+ * Like all other reader functions, this only skips the key when called
+ * in front of a key.
+ *
+ * Return: <0 on fatal error
+ *         0 on success
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if there is no next value in the current container
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_DEPTH_OVERFLOW if the nesting depth is too high
+ */
+_c_public_ int c_json_skip(CJson *json) {
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (json->states[json->level] == '{')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
-
-        /* strtoul() silently flips sign if first char is a minus */
-        if (*json->p == '-')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
-
-        number = strtoul(json->p, &end, 10);
+        c_json_mark(json);
 
-        if (end == json->p || *end == '.' || *end == 'e' || *end == 'E')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        return c_json_skip_value(json);
+}
 
-        json->p = end;
+/**
+ * c_json_validate() - check whether input is valid JSON
+ * @data                input
+ * @n_data              length of @data
+ * @max_depth           maximum nesting depth
+ *
+ * Validates @data as a single document, as c_json_skip() does on a reader
+ * that reads it. The nesting is tracked in the state of the reader
+ * rather than by recursion, so @max_depth only costs a bit per level.
+ * Nothing is decoded or converted, and strings are scanned with the same
+ * kernels that the readers use.
+ *
+ * Errors that a reader reports as C_JSON_E_INVALID_TYPE, such as a
+ * closing bracket in place of the document, make the input invalid.
+ *
+ * Return: <0 on fatal error
+ *         0 if @data is valid
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ *         C_JSON_E_DEPTH_OVERFLOW if the nesting depth is too high
+ */
+_c_public_ int c_json_validate(const void *data, size_t n_data, size_t max_depth) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        int r;
 
-        r = c_json_advance(json);
+        r = c_json_new(&json, max_depth);
         if (r)
                 return r;
 
-        if (numberp)
-                *numberp = number;
+        c_json_begin_read_n(json, data, n_data);
+        c_json_skip(json);
 
-        return 0;
+        r = c_json_end_read(json);
+
+        return r == C_JSON_E_INVALID_TYPE ? C_JSON_E_INVALID_JSON : r;
 }
 
-/**
- * c_json_read_f64() - read a number
- * @json                json object
- * @srtringp            return location for the number
+/*
+ * Reads keys of the current object and skips the values of those that
+ * @match() rejects, until it accepts one or the object ends. Each skipped
+ * member is committed, so in feed mode the search resumes behind it.
  *
  * Return: <0 on fatal error
- *         0 on success
+ *         0 on success, with *@indexp set to what @match() returned for
+ *         the matching key, or C_JSON_KEY_NONE at the end of the object
  *         the last error that occured in a reader function
- *         C_JSON_E_INVALID_TYPE if then next value is not a number
+ *         C_JSON_E_INVALID_TYPE if not in front of a key
  *         C_JSON_E_INVALID_JSON if the JSON input is malformed
  */
-_c_public_ int c_json_read_f64(CJson *json, double *numberp) {
-        char *end;
-        double number;
-        locale_t loc;
+static int c_json_find(CJson *json,
+                       size_t (*match)(const void *userdata, const char *key, size_t n_key),
+                       const void *userdata,
+                       size_t *indexp) {
+        const char *key;
+        size_t n_key, index;
         int r;
 
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (json->states[json->level] == '{')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        c_json_mark(json);
 
-        loc = newlocale(LC_NUMERIC_MASK, "C", (locale_t) 0);
-        uselocale(loc);
-        number = strtod(json->p, &end);
-        freelocale(loc);
+        if (json->state != '{' && json->state != '}')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
 
-        if (end == json->p)
-                return (json->poison = C_JSON_E_INVALID_JSON);
+        while (current(json) != '}') {
+                r = c_json_scan_string(json, &key, &n_key);
+                if (r)
+                        return c_json_fail(json, r);
 
-        json->p = end;
+                index = match(userdata, key, n_key);
 
-        r = c_json_advance(json);
-        if (r)
-                return r;
+                r = c_json_advance(json);
+                if (r)
+                        return r;
 
-        if (numberp)
-                *numberp = number;
+                if (index != C_JSON_KEY_NONE) {
+                        *indexp = index;
+                        return 0;
+                }
+
+                r = c_json_skip_value(json);
+                if (r)
+                        return r;
+
+                c_json_mark(json);
+        }
+
+        *indexp = C_JSON_KEY_NONE;
+
+        return 0;
+}
+
+typedef struct CJsonFindKey {
+        const char *key;
+        size_t n_key;
+} CJsonFindKey;
+
+static size_t c_json_find_key_match(const void *userdata, const char *key, size_t n_key) {
+        const CJsonFindKey *find = userdata;
+
+        if (n_key != find->n_key || memcmp(key, find->key, n_key))
+                return C_JSON_KEY_NONE;
 
         return 0;
 }
 
+static size_t c_json_find_keys_match(const void *userdata, const char *key, size_t n_key) {
+        return c_json_key_set_lookup(userdata, key, n_key);
+}
+
 /**
- * c_json_read_bool() - read a boolean
+ * c_json_find_key() - find a key in the current object
  * @json                json object
- * @srtringp            return location for the boolean
+ * @key                 key to look for
+ * @n_key               length of @key
+ * @foundp              return location for whether @key was found
+ *
+ * Reads keys of the current object, starting at the next one, and skips
+ * the members whose key is not @key. Keys are compared as they appear in
+ * the input, without copying them. If @key is found, it has been consumed
+ * and the next value is its value. Otherwise, the object has been read up
+ * to its end and can be closed.
  *
  * Return: <0 on fatal error
  *         0 on success
  *         the last error that occured in a reader function
- *         C_JSON_E_INVALID_TYPE if then next value is not a boolean
+ *         C_JSON_E_INVALID_TYPE if not in front of a key
  *         C_JSON_E_INVALID_JSON if the JSON input is malformed
  */
-_c_public_ int c_json_read_bool(CJson *json, bool *boolp) {
-        bool b;
+_c_public_ int c_json_find_key(CJson *json, const char *key, size_t n_key, bool *foundp) {
+        CJsonFindKey find = { .key = key, .n_key = n_key };
+        size_t index;
         int r;
 
-        if (json->states[json->level] == '{')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
-
-        if (_c_unlikely_(json->poison))
-                return json->poison;
+        r = c_json_find(json, c_json_find_key_match, &find, &index);
+        if (r)
+                return r;
 
-        switch (*json->p) {
-                case 't':
-                        if (strncmp(json->p, "true", strlen("true")))
-                                return (json->poison = C_JSON_E_INVALID_JSON);
-                        b = true;
-                        json->p += strlen("true");
-                        break;
+        if (foundp)
+                *foundp = index != C_JSON_KEY_NONE;
 
-                case 'f':
-                        if (strncmp(json->p, "false", strlen("false")))
-                                return (json->poison = C_JSON_E_INVALID_JSON);
-                        b = false;
-                        json->p += strlen("false");
-                        break;
+        return 0;
+}
 
-                default:
-                        return (json->poison = C_JSON_E_INVALID_TYPE);
-        }
+/**
+ * c_json_find_keys() - find the next of several keys in the current object
+ * @json                json object
+ * @set                 keys to look for
+ * @indexp              return location for the index of the key found
+ *
+ * Like c_json_find_key(), but stops at the first key that is part of
+ * @set. Looking up a key costs the same regardless of the size of @set.
+ *
+ * Return: <0 on fatal error
+ *         0 on success, with *@indexp set to the index of the key in @set,
+ *         or C_JSON_KEY_NONE at the end of the object
+ *         the last error that occured in a reader function
+ *         C_JSON_E_INVALID_TYPE if not in front of a key
+ *         C_JSON_E_INVALID_JSON if the JSON input is malformed
+ */
+_c_public_ int c_json_find_keys(CJson *json, const CJsonKeySet *set, size_t *indexp) {
+        size_t index;
+        int r;
 
-        r = c_json_advance(json);
+        r = c_json_find(json, c_json_find_keys_match, set, &index);
         if (r)
                 return r;
 
-        if (boolp)
-                *boolp = b;
+        if (indexp)
+                *indexp = index;
 
         return 0;
 }
@@ -623,16 +2112,16 @@ _c_public_ bool c_json_more(CJson *json) {
         if (_c_unlikely_(json->poison))
                 return false;
 
-        if (!*json->p)
+        if (!current(json))
                 return false;
 
-        switch (json->states[json->level]) {
+        switch (json->state) {
                 case '[':
-                        return *json->p != ']';
+                        return current(json) != ']';
 
                 case '{':
-                case ':':
-                        return *json->p != '}';
+                case '}':
+                        return current(json) != '}';
         }
 
         return true;
@@ -653,17 +2142,25 @@ _c_public_ int c_json_open_array(CJson *json) {
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (json->states[json->level] == '{')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        c_json_mark(json);
 
-        if (*json->p != '[')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        if (json->state == '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        if (current(json) != '[')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
 
         if (json->level >= json->n_states)
-                return (json->poison = C_JSON_E_DEPTH_OVERFLOW);
+                return c_json_fail(json, C_JSON_E_DEPTH_OVERFLOW);
+
+        json->p = skip_space(json, json->p + 1);
+        if (c_json_starved(json))
+                return c_json_again(json);
+
+        c_json_push(json, '[');
 
-        json->p = skip_space(json->p + 1);
-        json->states[++json->level] = '[';
+        c_json_stat(json, n_values[C_JSON_TYPE_ARRAY], 1);
+        c_json_stat_max(json, max_depth, json->level);
 
         return 0;
 }
@@ -682,14 +2179,16 @@ _c_public_ int c_json_close_array(CJson *json) {
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (json->states[json->level] != '[' && json->states[json->level] != ',')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        c_json_mark(json);
 
-        if (*json->p != ']')
-                return (json->poison = C_JSON_E_INVALID_JSON);
+        if (json->state != '[' && json->state != ',')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        if (current(json) != ']')
+                return c_json_fail(json, C_JSON_E_INVALID_JSON);
 
         json->p += 1;
-        json->level -= 1;
+        c_json_pop(json);
 
         return c_json_advance(json);
 }
@@ -709,20 +2208,25 @@ _c_public_ int c_json_open_object(CJson *json) {
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (json->states[json->level] == '{')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        c_json_mark(json);
 
-        if (*json->p != '{')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        if (json->state == '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        if (current(json) != '{')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
 
         if (json->level >= json->n_states)
-                return (json->poison = C_JSON_E_DEPTH_OVERFLOW);
+                return c_json_fail(json, C_JSON_E_DEPTH_OVERFLOW);
 
-        json->p = skip_space(json->p + 1);
-        if (*json->p != '"' && *json->p != '}')
-                return (json->poison = C_JSON_E_INVALID_JSON);
+        json->p = skip_space(json, json->p + 1);
+        if (current(json) != '"' && current(json) != '}')
+                return c_json_fail(json, C_JSON_E_INVALID_JSON);
+
+        c_json_push(json, '{');
 
-        json->states[++json->level] = '{';
+        c_json_stat(json, n_values[C_JSON_TYPE_OBJECT], 1);
+        c_json_stat_max(json, max_depth, json->level);
 
         return 0;
 }
@@ -741,14 +2245,20 @@ _c_public_ int c_json_close_object(CJson *json) {
         if (_c_unlikely_(json->poison))
                 return json->poison;
 
-        if (json->states[json->level] != '{' && json->states[json->level] != ':')
-                return (json->poison = C_JSON_E_INVALID_TYPE);
+        c_json_mark(json);
 
-        if (*json->p != '}')
-                return (json->poison = C_JSON_E_INVALID_JSON);
+        /* a value must follow the colon */
+        if (json->state == ':' && current(json) == '}')
+                return c_json_fail(json, C_JSON_E_INVALID_JSON);
+
+        if (json->state != '{' && json->state != '}')
+                return c_json_fail(json, C_JSON_E_INVALID_TYPE);
+
+        if (current(json) != '}')
+                return c_json_fail(json, C_JSON_E_INVALID_JSON);
 
         json->p += 1;
-        json->level -= 1;
+        c_json_pop(json);
 
         return c_json_advance(json);
 }
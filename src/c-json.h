@@ -6,15 +6,38 @@ extern "C" {
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct CJson CJson;
+typedef struct CJsonKeySet CJsonKeySet;
+typedef struct CJsonPool CJsonPool;
 typedef struct CJsonLevel CJsonLevel;
+typedef struct CJsonDoc CJsonDoc;
+typedef struct CJsonPaths CJsonPaths;
+typedef struct CJsonStruct CJsonStruct;
+typedef struct CJsonSymbols CJsonSymbols;
+
+#define C_JSON_KEY_NONE ((size_t)-1)
+
+typedef void *(*CJsonArenaGrowFn)(void *userdata, size_t n_min, size_t *np);
+typedef int (*CJsonFlushFn)(void *userdata, const char *data, size_t n_data);
+typedef int (*CJsonRecordFn)(void *userdata, CJson *json, size_t offset);
+typedef int (*CJsonPathFn)(void *userdata, CJson *json, size_t index);
 
 enum  {
         _C_JSON_E_SUCCESS,
         C_JSON_E_INVALID_JSON,
         C_JSON_E_INVALID_TYPE,
         C_JSON_E_DEPTH_OVERFLOW,
+        C_JSON_E_OUT_OF_RANGE,
+        C_JSON_E_AGAIN,
+};
+
+enum {
+        C_JSON_FLAG_TRUSTED             = (1 << 0),
+        C_JSON_FLAG_INDEX               = (1 << 1),
+        C_JSON_FLAG_UTF8                = (1 << 2),
 };
 
 enum {
@@ -24,30 +47,201 @@ enum {
         C_JSON_TYPE_NUMBER,
         C_JSON_TYPE_ARRAY,
         C_JSON_TYPE_OBJECT,
+        _C_JSON_TYPE_N,
+};
+
+enum {
+        C_JSON_FIELD_BOOL,
+        C_JSON_FIELD_U64,
+        C_JSON_FIELD_I64,
+        C_JSON_FIELD_F64,
+        C_JSON_FIELD_STRING,
+        C_JSON_FIELD_OBJECT,
 };
 
+/*
+ * A member of a struct that the value of @key is read into, see
+ * c_json_struct_new(). @type is one of C_JSON_FIELD_*, which are read into
+ * a bool, uint64_t, int64_t, double, char * or a nested struct described
+ * by @fields, respectively. The offsets in @fields are relative to the
+ * nested struct.
+ */
+typedef struct CJsonField {
+        const char *key;
+        unsigned int type;
+        size_t offset;
+        const struct CJsonField *fields;
+        size_t n_fields;
+} CJsonField;
+
+#define C_JSON_FIELD(_key, _type, _struct, _member) {                           \
+                .key = (_key),                                                  \
+                .type = (_type),                                                \
+                .offset = offsetof(_struct, _member),                           \
+        }
+
+#define C_JSON_FIELD_NESTED(_key, _struct, _member, _fields) {                  \
+                .key = (_key),                                                  \
+                .type = C_JSON_FIELD_OBJECT,                                    \
+                .offset = offsetof(_struct, _member),                           \
+                .fields = (_fields),                                            \
+                .n_fields = sizeof(_fields) / sizeof((_fields)[0]),             \
+        }
+
+/*
+ * Counters of a reader, see c_json_get_stats(). Fields may be added at the
+ * end, but are never reordered.
+ */
+typedef struct CJsonStats {
+        uint64_t n_bytes;
+        uint64_t n_values[_C_JSON_TYPE_N];
+        uint64_t n_skipped;
+        uint64_t n_strings_borrowed;
+        uint64_t n_strings_decoded;
+        uint64_t n_escapes;
+        uint64_t n_space;
+        uint64_t n_allocations;
+        uint64_t max_depth;
+        uint64_t ns_strings;
+        uint64_t ns_numbers;
+} CJsonStats;
+
 int c_json_new(CJson **jsonp, size_t max_depth);
 CJson * c_json_free(CJson *json);
+void c_json_set_flags(CJson *json, unsigned int flags);
+void c_json_set_arena(CJson *json,
+                      void *buffer,
+                      size_t n_buffer,
+                      CJsonArenaGrowFn grow,
+                      void *userdata);
+void c_json_set_symbols(CJson *json, CJsonSymbols *symbols);
+void c_json_reset(CJson *json);
+int c_json_get_stats(CJson *json, CJsonStats *statsp);
 
 void c_json_begin_read(CJson *json, const char *string);
+void c_json_begin_read_n(CJson *json, const void *data, size_t n_data);
+void c_json_begin_read_inplace(CJson *json, char *data, size_t n_data);
+int c_json_begin_read_file(CJson *json, int fd);
+const char * c_json_get_input(CJson *json, size_t *np);
 int c_json_end_read(CJson *json);
+int c_json_next_document(CJson *json, bool *morep);
+void c_json_begin_feed(CJson *json);
+int c_json_feed(CJson *json, const void *data, size_t n_data);
 int c_json_peek(CJson *json);
 int c_json_read_null(CJson *json);
 int c_json_read_string(CJson *json, char **stringp);
+int c_json_read_string_view(CJson *json, const char **stringp, size_t *np);
+int c_json_read_key(CJson *json, const char **keyp, size_t *idp);
 int c_json_read_u64(CJson *json, uint64_t *numberp);
+int c_json_read_i64(CJson *json, int64_t *numberp);
 int c_json_read_f64(CJson *json, double *numberp);
 int c_json_read_bool(CJson *json, bool *boolp);
+int c_json_read_u64_array(CJson *json, uint64_t *values, size_t n_max, size_t *np);
+int c_json_read_f64_array(CJson *json, double *values, size_t n_max, size_t *np);
+int c_json_skip(CJson *json);
+int c_json_validate(const void *data, size_t n_data, size_t max_depth);
+int c_json_find_key(CJson *json, const char *key, size_t n_key, bool *foundp);
+int c_json_find_keys(CJson *json, const CJsonKeySet *set, size_t *indexp);
+int c_json_find_paths(CJson *json, const CJsonPaths *paths, CJsonPathFn fn, void *userdata);
 bool c_json_more(CJson *json);
 int c_json_open_array(CJson *json);
 int c_json_close_array(CJson *json);
 int c_json_open_object(CJson *json);
 int c_json_close_object(CJson *json);
 
+void c_json_begin_write(CJson *json, CJsonFlushFn flush, void *userdata);
+int c_json_end_write(CJson *json, char **datap, size_t *n_datap);
+int c_json_write_null(CJson *json);
+int c_json_write_bool(CJson *json, bool b);
+int c_json_write_string(CJson *json, const char *string);
+int c_json_write_string_n(CJson *json, const char *string, size_t n);
+int c_json_write_u64(CJson *json, uint64_t number);
+int c_json_write_i64(CJson *json, int64_t number);
+int c_json_write_f64(CJson *json, double number);
+int c_json_write_open_array(CJson *json);
+int c_json_write_close_array(CJson *json);
+int c_json_write_open_object(CJson *json);
+int c_json_write_close_object(CJson *json);
+
+int c_json_key_set_new(CJsonKeySet **setp, const char * const *keys, size_t n_keys);
+CJsonKeySet * c_json_key_set_free(CJsonKeySet *set);
+
+int c_json_symbols_new(CJsonSymbols **symbolsp, size_t n_max);
+CJsonSymbols * c_json_symbols_free(CJsonSymbols *symbols);
+void c_json_symbols_freeze(CJsonSymbols *symbols);
+int c_json_symbols_add(CJsonSymbols *symbols, const char *key, size_t n_key, size_t *idp);
+const char * c_json_symbols_get(const CJsonSymbols *symbols, size_t id, size_t *np);
+size_t c_json_symbols_count(const CJsonSymbols *symbols);
+
+int c_json_struct_new(CJsonStruct **structp, const CJsonField *fields, size_t n_fields);
+CJsonStruct * c_json_struct_free(CJsonStruct *desc);
+int c_json_read_struct(CJson *json, const CJsonStruct *desc, void *out);
+
+int c_json_paths_new(CJsonPaths **pathsp, const char * const *paths, size_t n_paths);
+CJsonPaths * c_json_paths_free(CJsonPaths *paths);
+
+int c_json_pool_new(CJsonPool **poolp, size_t max_depth, size_t n_max);
+CJsonPool * c_json_pool_free(CJsonPool *pool);
+int c_json_pool_get(CJsonPool *pool, CJson **jsonp);
+CJson * c_json_pool_put(CJsonPool *pool, CJson *json);
+
+int c_json_doc_new(CJsonDoc **docp);
+CJsonDoc * c_json_doc_free(CJsonDoc *doc);
+int c_json_doc_read(CJsonDoc *doc, CJson *json);
+int c_json_doc_type(CJsonDoc *doc, size_t index);
+size_t c_json_doc_next(CJsonDoc *doc, size_t index);
+size_t c_json_doc_child(CJsonDoc *doc, size_t index);
+size_t c_json_doc_length(CJsonDoc *doc, size_t index);
+size_t c_json_doc_find_key(CJsonDoc *doc, size_t index, const char *key, size_t n_key);
+int c_json_doc_get_string(CJsonDoc *doc, size_t index, const char **stringp, size_t *np);
+int c_json_doc_get_u64(CJsonDoc *doc, size_t index, uint64_t *numberp);
+int c_json_doc_get_i64(CJsonDoc *doc, size_t index, int64_t *numberp);
+int c_json_doc_get_f64(CJsonDoc *doc, size_t index, double *numberp);
+int c_json_doc_get_bool(CJsonDoc *doc, size_t index, bool *boolp);
+
+int c_json_dispatch_lines(const void *data,
+                          size_t n_data,
+                          size_t n_workers,
+                          size_t max_depth,
+                          unsigned int flags,
+                          CJsonRecordFn fn,
+                          void *userdata);
+
 static inline void c_json_freep(CJson **jsonp) {
         if (*jsonp)
                 c_json_free(*jsonp);
 }
 
+static inline void c_json_key_set_freep(CJsonKeySet **setp) {
+        if (*setp)
+                c_json_key_set_free(*setp);
+}
+
+static inline void c_json_symbols_freep(CJsonSymbols **symbolsp) {
+        if (*symbolsp)
+                c_json_symbols_free(*symbolsp);
+}
+
+static inline void c_json_struct_freep(CJsonStruct **descp) {
+        if (*descp)
+                c_json_struct_free(*descp);
+}
+
+static inline void c_json_paths_freep(CJsonPaths **pathsp) {
+        if (*pathsp)
+                c_json_paths_free(*pathsp);
+}
+
+static inline void c_json_pool_freep(CJsonPool **poolp) {
+        if (*poolp)
+                c_json_pool_free(*poolp);
+}
+
+static inline void c_json_doc_freep(CJsonDoc **docp) {
+        if (*docp)
+                c_json_doc_free(*docp);
+}
+
 #ifdef __cplusplus
 }
 #endif
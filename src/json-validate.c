@@ -1,10 +1,19 @@
-
 #undef NDEBUG
 #include <c-stdaux.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include "c-json.h"
 
-int read_file(FILE *file, char **contentsp) {
+#define FEED_SIZE (1024 * 1024)
+#define MAX_DEPTH 256
+
+/* more threads than this per CPU only add overhead */
+#define MAX_JOBS_PER_CPU 8
+
+int read_file(FILE *file, char **contentsp, size_t *np) {
         _c_cleanup_ (c_fclosep) FILE *stream = NULL;
         _c_cleanup_ (c_freep) char *contents = NULL;
         size_t n_input;
@@ -30,73 +39,399 @@ int read_file(FILE *file, char **contentsp) {
 
         stream = c_fclose(stream);
         *contentsp = contents;
+        *np = n_input;
         contents = NULL;
 
         return 0;
 }
 
-int json_read_value(CJson *json) {
-        switch (c_json_peek(json)) {
-                case C_JSON_TYPE_NULL:
-                        return c_json_read_null(json);
+/*
+ * Feeds a reader from up to three pieces of input, in slices of at most
+ * FEED_SIZE bytes, followed by the end of the input.
+ */
+typedef struct Piece {
+        const char *data;
+        size_t n;
+} Piece;
 
-                case C_JSON_TYPE_BOOLEAN:
-                        return c_json_read_bool(json, NULL);
+typedef struct Feeder {
+        CJson *json;
+        Piece pieces[3];
+        size_t n_pieces;
+        size_t i_piece;
+        size_t n_fed;
+        bool final;
+} Feeder;
 
-                case C_JSON_TYPE_STRING:
-                        return c_json_read_string(json, NULL);
+static int feeder_next(Feeder *f) {
+        size_t n;
+        int r;
 
-                case C_JSON_TYPE_NUMBER:
-                        return c_json_read_f64(json, NULL);
+        while (f->i_piece < f->n_pieces && f->n_fed >= f->pieces[f->i_piece].n) {
+                f->i_piece += 1;
+                f->n_fed = 0;
+        }
 
-                case C_JSON_TYPE_ARRAY:
-                        c_json_open_array(json);
-                        while (c_json_more(json)) {
-                                int r = json_read_value(json);
-                                if (r)
-                                        return r;
-                        }
-                        return c_json_close_array(json);
+        if (f->i_piece >= f->n_pieces) {
+                if (f->final)
+                        return 0;
 
-                case C_JSON_TYPE_OBJECT:
-                        c_json_open_object(json);
-                        while (c_json_more(json)) {
-                                int r = json_read_value(json);
-                                if (r)
-                                        return r;
-                        }
-                        return c_json_close_object(json);
+                f->final = true;
+                return c_json_feed(f->json, NULL, 0);
+        }
+
+        n = c_min(f->pieces[f->i_piece].n - f->n_fed, (size_t)FEED_SIZE);
+        r = c_json_feed(f->json, f->pieces[f->i_piece].data + f->n_fed, n);
+        f->n_fed += n;
+
+        return r;
+}
+
+/* retries a reader until it has all the input it needs */
+#define READ(_f, _call) ({                                                      \
+                int _r;                                                         \
+                while ((_r = (_call)) == C_JSON_E_AGAIN)                        \
+                        feeder_next(_f);                                        \
+                _r;                                                             \
+        })
+
+/*
+ * Parallel validation
+ *
+ * The input is cut into one chunk per job. Each chunk is scanned in
+ * parallel for quotes, escapes and brackets twice, once assuming that it
+ * starts outside of a string and once that it starts inside of one. The
+ * start states of all chunks then follow in order.
+ *
+ * Behind the start of each chunk, the first ',' that separates members
+ * of the root container splits the input into segments. Each segment is
+ * then validated in parallel as the members of a container of the same
+ * type, with the brackets it lacks fed around it, and has to contain at
+ * least one member. If all segments are valid, so is the input. Only the
+ * readers decide validity, the scan merely picks where to split, so even
+ * a wrong guess on invalid input cannot accept it. The first segment that
+ * fails determines the result, as it would when validating in order.
+ */
+
+typedef struct Scan {
+        bool in_string;
+        bool escaped;
+        ssize_t depth;
+} Scan;
+
+typedef struct Chunk {
+        const char *start;
+        const char *end;
+        Scan scans[2];
+        pthread_t thread;
+} Chunk;
+
+typedef struct Segment {
+        const char *start;
+        const char *end;
+        char open;
+        bool first;
+        bool last;
+        int r;
+        pthread_t thread;
+} Segment;
+
+/*
+ * Scans [@p, @end) for quotes, escapes and brackets. If @split is set,
+ * stops at the first ',' outside of a string at depth 1.
+ */
+static const char *scan_run(Scan *s, const char *p, const char *end, bool split) {
+        for (; p < end; p += 1) {
+                if (s->in_string) {
+                        if (s->escaped)
+                                s->escaped = false;
+                        else if (*p == '\\')
+                                s->escaped = true;
+                        else if (*p == '"')
+                                s->in_string = false;
+                        continue;
+                }
+
+                switch (*p) {
+                        case '"':
+                                s->in_string = true;
+                                break;
+                        case '[':
+                        case '{':
+                                s->depth += 1;
+                                break;
+                        case ']':
+                        case '}':
+                                s->depth -= 1;
+                                break;
+                        case ',':
+                                if (split && s->depth == 1)
+                                        return p;
+                                break;
+                }
+        }
+
+        return end;
+}
+
+static void *chunk_scan(void *userdata) {
+        Chunk *chunk = userdata;
+
+        chunk->scans[0] = (Scan){ .in_string = false };
+        chunk->scans[1] = (Scan){ .in_string = true };
+        scan_run(&chunk->scans[0], chunk->start, chunk->end, false);
+        scan_run(&chunk->scans[1], chunk->start, chunk->end, false);
+
+        return NULL;
+}
+
+static void *segment_validate(void *userdata) {
+        _c_cleanup_ (c_json_freep) CJson *json = NULL;
+        static const char close[] = { ['['] = ']', ['{'] = '}' };
+        Segment *segment = userdata;
+        Feeder f = {};
+        size_t n_members = 0;
+        int r;
 
-                default:
-                        return C_JSON_E_INVALID_JSON;
+        r = c_json_new(&json, MAX_DEPTH);
+        if (r) {
+                segment->r = r;
+                return NULL;
         }
+
+        f.json = json;
+        if (!segment->first)
+                f.pieces[f.n_pieces++] = (Piece){ &segment->open, 1 };
+        f.pieces[f.n_pieces++] = (Piece){ segment->start, segment->end - segment->start };
+        if (!segment->last)
+                f.pieces[f.n_pieces++] = (Piece){ &close[(int)segment->open], 1 };
+
+        c_json_begin_feed(json);
+        while (feeder_next(&f) == C_JSON_E_AGAIN)
+                ;
+
+        if (segment->open == '[')
+                READ(&f, c_json_open_array(json));
+        else
+                READ(&f, c_json_open_object(json));
+
+        /* keys are skipped like values */
+        r = 0;
+        while (c_json_more(json)) {
+                r = READ(&f, c_json_skip(json));
+                if (!r && segment->open == '{')
+                        r = READ(&f, c_json_skip(json));
+                if (r)
+                        break;
+                n_members += 1;
+        }
+
+        if (!r && segment->open == '[')
+                r = READ(&f, c_json_close_array(json));
+        else if (!r)
+                r = READ(&f, c_json_close_object(json));
+
+        /* each split separates two members */
+        if (!r && n_members == 0)
+                r = C_JSON_E_INVALID_JSON;
+
+        while (!f.final)
+                feeder_next(&f);
+
+        if (!r)
+                r = c_json_end_read(json);
+        else
+                c_json_end_read(json);
+
+        /* like c_json_validate(), a missing value makes the input invalid */
+        segment->r = r == C_JSON_E_INVALID_TYPE ? C_JSON_E_INVALID_JSON : r;
+
+        return NULL;
+}
+
+/*
+ * Validates @input with @n_jobs threads. Sets *@splitp to false if the
+ * input cannot be split, or not enough threads can be started, and makes
+ * no statement about it then.
+ */
+static int validate_parallel(const char *input, size_t n_input, size_t n_jobs, bool *splitp) {
+        _c_cleanup_ (c_freep) Segment *segments = NULL;
+        _c_cleanup_ (c_freep) Chunk *chunks = NULL;
+        const char *end = input + n_input, *p;
+        size_t n_segments = 0, n_started;
+        char open;
+        Scan scan;
+
+        for (p = input; p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'); p += 1)
+                ;
+        *splitp = false;
+        if (p >= end || (*p != '[' && *p != '{'))
+                return 0;
+        open = *p;
+
+        chunks = calloc(n_jobs, sizeof(*chunks));
+        segments = calloc(n_jobs, sizeof(*segments));
+        if (!chunks || !segments)
+                return -ENOMEM;
+
+        /* a chunk never starts behind a backslash, so it never starts escaped */
+        for (size_t i = 0; i < n_jobs; i += 1) {
+                chunks[i].start = i ? chunks[i - 1].end : input;
+                chunks[i].end = input + n_input / n_jobs * (i + 1);
+                if (i == n_jobs - 1)
+                        chunks[i].end = end;
+                while (chunks[i].end < end && chunks[i].end > chunks[i].start && chunks[i].end[-1] == '\\')
+                        chunks[i].end += 1;
+        }
+
+        for (n_started = 0; n_started < n_jobs; n_started += 1)
+                if (pthread_create(&chunks[n_started].thread, NULL, chunk_scan, &chunks[n_started]))
+                        break;
+        for (size_t i = 0; i < n_started; i += 1)
+                pthread_join(chunks[i].thread, NULL);
+        if (n_started < n_jobs)
+                return 0;
+
+        /*
+         * Stitch the chunks together, and split at the first separator
+         * within each chunk behind the first. The search for it does not
+         * reach further, so it stays short unless there is none.
+         */
+        scan = (Scan){};
+        for (size_t i = 0; i < n_jobs; i += 1) {
+                const Scan *result = &chunks[i].scans[scan.in_string];
+                Scan split = scan;
+
+                p = i ? scan_run(&split, chunks[i].start, chunks[i].end, true) : chunks[i].end;
+                if (p < chunks[i].end) {
+                        segments[n_segments].start = n_segments ? segments[n_segments - 1].end + 1 : input;
+                        segments[n_segments].end = p;
+                        n_segments += 1;
+                }
+
+                scan.in_string = result->in_string;
+                scan.depth += result->depth;
+        }
+
+        if (n_segments == 0)
+                return 0;
+
+        /* the remainder follows the last split */
+        segments[n_segments].start = segments[n_segments - 1].end + 1;
+        segments[n_segments].end = end;
+        n_segments += 1;
+
+        for (n_started = 0; n_started < n_segments; n_started += 1) {
+                segments[n_started].open = open;
+                segments[n_started].first = n_started == 0;
+                segments[n_started].last = n_started == n_segments - 1;
+                if (pthread_create(&segments[n_started].thread, NULL, segment_validate, &segments[n_started]))
+                        break;
+        }
+        for (size_t i = 0; i < n_started; i += 1)
+                pthread_join(segments[i].thread, NULL);
+        if (n_started < n_segments)
+                return 0;
+
+        *splitp = true;
+
+        for (size_t i = 0; i < n_segments; i += 1)
+                if (segments[i].r)
+                        return segments[i].r;
+
+        return 0;
+}
+
+/*
+ * Parses the argument of --jobs, which is capped at a multiple of the
+ * number of CPUs.
+ */
+static int parse_jobs(const char *arg, size_t *n_jobsp) {
+        unsigned long n;
+        long n_cpus;
+        char *end;
+
+        /* strtoul() would accept a sign, and wrap negative numbers */
+        if (*arg < '0' || *arg > '9')
+                return -EINVAL;
+
+        errno = 0;
+        n = strtoul(arg, &end, 10);
+        if (errno || *end || n < 1)
+                return -EINVAL;
+
+        n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        *n_jobsp = c_min((size_t)n, (size_t)MAX_JOBS_PER_CPU * (n_cpus > 0 ? n_cpus : 1));
+
+        return 0;
 }
 
 int main(int argc, char **argv) {
+        static const struct option options[] = {
+                { "jobs", required_argument, NULL, 'j' },
+                {}
+        };
         _c_cleanup_ (c_fclosep) FILE *file = NULL;
         _c_cleanup_ (c_json_freep) CJson *json = NULL;
         _c_cleanup_ (c_freep) char *input = NULL;
-        int r;
+        const char *data = NULL;
+        size_t n_input, n_jobs = 1;
+        bool split = false;
+        int r, c;
 
-        if (argc < 2) {
-                r = read_file(stdin, &input);
-                if (r)
-                        return 1;
-        } else {
-                file = fopen(argv[1], "r");
+        while ((c = getopt_long(argc, argv, "j:", options, NULL)) >= 0) {
+                switch (c) {
+                        case 'j':
+                                r = parse_jobs(optarg, &n_jobs);
+                                if (r)
+                                        return r;
+                                break;
+                        default:
+                                return -EINVAL;
+                }
+        }
+
+        c_json_new(&json, MAX_DEPTH);
+
+        if (optind < argc) {
+                file = fopen(argv[optind], "r");
                 if (!file)
                         return -errno;
+        }
 
-                r = read_file(file, &input);
+        /*
+         * Regular files are mapped and read in place, everything else is
+         * copied into memory. Parallel validation hands out slices of
+         * either to several readers.
+         */
+        if (file) {
+                r = c_json_begin_read_file(json, fileno(file));
+                if (r < 0 && r != -ENODEV)
+                        return 1;
+                if (!r)
+                        data = c_json_get_input(json, &n_input);
+        }
+
+        if (!data) {
+                r = read_file(file ?: stdin, &input, &n_input);
                 if (r)
                         return 1;
+                data = input;
         }
 
-        c_json_new(&json, 256);
-        c_json_begin_read(json, input);
-        r = json_read_value(json);
-        if (r)
-                return r;
+        /* falls back to validating in order if the input cannot be split, or threads cannot be started */
+        if (n_jobs > 1 && n_input >= n_jobs) {
+                r = validate_parallel(data, n_input, n_jobs, &split);
+                if (split || r < 0)
+                        return r;
+        }
+
+        if (input)
+                return c_json_validate(input, n_input, MAX_DEPTH);
+
+        /* this is what c_json_validate() does, on the mapped file */
+        c_json_skip(json);
+        r = c_json_end_read(json);
 
-        return c_json_end_read(json);
+        return r == C_JSON_E_INVALID_TYPE ? C_JSON_E_INVALID_JSON : r;
 }
@@ -2,7 +2,11 @@
 #undef NDEBUG
 #include <assert.h>
 #include <c-stdaux.h>
+#include <math.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "c-json.h"
 
 static void test_basic(void) {
@@ -53,6 +57,94 @@ static void test_basic(void) {
         json = c_json_free(json);
 }
 
+static void test_f64(void) {
+        static const struct {
+                const char *input;
+                double value;
+        } valid[] = {
+                { "0", 0 },
+                { "-0.0", -0.0 },
+                { "1e23", 1e23 },
+                { "0.1", 0.1 },
+                { "-2.5E-3", -2.5e-3 },
+                { "9007199254740993", 9007199254740992.0 },
+                { "2.2250738585072011e-308", 2.2250738585072011e-308 },
+                { "4.9e-324", 4.9e-324 },
+                { "1.7976931348623157e308", 1.7976931348623157e308 },
+                { "123456789012345678901234567890", 123456789012345678901234567890.0 },
+        };
+        static const char *invalid[] = {
+                "01", "-", "1.", "1.e3", "1e", "1e+", "-Infinity", "0x10",
+        };
+        static CJson *json = NULL;
+        double f64;
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(valid); i += 1) {
+                assert(!c_json_new(&json, 256));
+                c_json_begin_read(json, valid[i].input);
+                assert(!c_json_read_f64(json, &f64));
+                assert(!memcmp(&f64, &valid[i].value, sizeof(f64)));
+                assert(!c_json_end_read(json));
+                json = c_json_free(json);
+        }
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(invalid); i += 1) {
+                assert(!c_json_new(&json, 256));
+                c_json_begin_read(json, invalid[i]);
+                c_json_read_f64(json, &f64);
+                assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+                json = c_json_free(json);
+        }
+
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, "\"1\"");
+        assert(c_json_read_f64(json, &f64) == C_JSON_E_INVALID_TYPE);
+        json = c_json_free(json);
+}
+
+static void test_integer(void) {
+        static const struct {
+                const char *input;
+                int u64;
+                uint64_t u64_value;
+                int i64;
+                int64_t i64_value;
+        } tests[] = {
+                { "0", 0, 0, 0, 0 },
+                { "-0", C_JSON_E_INVALID_TYPE, 0, 0, 0 },
+                { "18446744073709551615", 0, UINT64_MAX, C_JSON_E_OUT_OF_RANGE, 0 },
+                { "18446744073709551616", C_JSON_E_OUT_OF_RANGE, 0, C_JSON_E_OUT_OF_RANGE, 0 },
+                { "99999999999999999999", C_JSON_E_OUT_OF_RANGE, 0, C_JSON_E_OUT_OF_RANGE, 0 },
+                { "9223372036854775807", 0, INT64_MAX, 0, INT64_MAX },
+                { "9223372036854775808", 0, (uint64_t)INT64_MAX + 1, C_JSON_E_OUT_OF_RANGE, 0 },
+                { "-9223372036854775808", C_JSON_E_INVALID_TYPE, 0, 0, INT64_MIN },
+                { "-9223372036854775809", C_JSON_E_INVALID_TYPE, 0, C_JSON_E_OUT_OF_RANGE, 0 },
+                { "1.0", C_JSON_E_INVALID_TYPE, 0, C_JSON_E_INVALID_TYPE, 0 },
+                { "1e3", C_JSON_E_INVALID_TYPE, 0, C_JSON_E_INVALID_TYPE, 0 },
+                { "-", C_JSON_E_INVALID_TYPE, 0, C_JSON_E_INVALID_JSON, 0 },
+                { "+1", C_JSON_E_INVALID_TYPE, 0, C_JSON_E_INVALID_TYPE, 0 },
+                { " 012", C_JSON_E_INVALID_JSON, 0, C_JSON_E_INVALID_JSON, 0 },
+        };
+        static CJson *json = NULL;
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(tests); i += 1) {
+                uint64_t u64 = 0;
+                int64_t i64 = 0;
+
+                assert(!c_json_new(&json, 256));
+                c_json_begin_read(json, tests[i].input);
+                assert(c_json_read_u64(json, &u64) == tests[i].u64);
+                assert(u64 == tests[i].u64_value);
+                json = c_json_free(json);
+
+                assert(!c_json_new(&json, 256));
+                c_json_begin_read(json, tests[i].input);
+                assert(c_json_read_i64(json, &i64) == tests[i].i64);
+                assert(i64 == tests[i].i64_value);
+                json = c_json_free(json);
+        }
+}
+
 static void test_array(void) {
         static CJson *json = NULL;
 
@@ -111,6 +203,1748 @@ static void test_object(void) {
         json = c_json_free(json);
 }
 
+static void test_string_view(void) {
+        static CJson *json = NULL;
+        const char *input = "[ \"foo\", \"\", \"a\\nb\\u00e4\\ud83d\\ude00\" ]";
+        const char *string;
+        size_t n;
+
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, input);
+        assert(!c_json_open_array(json));
+
+        assert(!c_json_read_string_view(json, &string, &n));
+        assert(n == 3 && !memcmp(string, "foo", 3));
+        assert(string > input && string < input + strlen(input));
+
+        assert(!c_json_read_string_view(json, &string, &n));
+        assert(n == 0);
+
+        assert(!c_json_read_string_view(json, &string, &n));
+        assert(n == strlen("a\nbä😀") && !memcmp(string, "a\nbä😀", n));
+
+        assert(!c_json_close_array(json));
+        assert(!c_json_end_read(json));
+
+        c_json_begin_read(json, "\"foo\\x\"");
+        assert(c_json_read_string_view(json, &string, &n) == C_JSON_E_INVALID_JSON);
+        assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+        json = c_json_free(json);
+}
+
+static void test_string_scan(void) {
+        static CJson *json = NULL;
+        char input[256], expected[128];
+        const char *string;
+        size_t n;
+
+        /*
+         * Move the interesting byte across every offset of a vector
+         * block, and the start of the string across every alignment.
+         */
+        for (size_t offset = 0; offset < 32; offset += 1) {
+                for (size_t length = 1; length < 100; length += 1) {
+                        memset(input, ' ', offset);
+                        input[offset] = '"';
+                        memset(input + offset + 1, 'x', length);
+                        strcpy(input + offset + 1 + length, "\"");
+
+                        assert(!c_json_new(&json, 256));
+                        c_json_begin_read(json, input);
+                        assert(!c_json_read_string_view(json, &string, &n));
+                        assert(n == length && string == input + offset + 1);
+                        assert(!c_json_end_read(json));
+                        json = c_json_free(json);
+
+                        for (size_t i = 0; i < length; i += 1) {
+                                memset(expected, 'x', length);
+                                expected[i] = '"';
+                                memcpy(input + offset + 1 + i, "\\\"", 2);
+                                memset(input + offset + 3 + i, 'x', length - i - 1);
+                                strcpy(input + offset + 2 + length, "\"");
+
+                                assert(!c_json_new(&json, 256));
+                                c_json_begin_read(json, input);
+                                assert(!c_json_read_string_view(json, &string, &n));
+                                assert(n == length && !memcmp(string, expected, n));
+                                assert(!c_json_end_read(json));
+                                json = c_json_free(json);
+
+                                memset(input + offset + 1, 'x', length);
+                                input[offset + 1 + i] = '\t';
+                                strcpy(input + offset + 1 + length, "\"");
+
+                                assert(!c_json_new(&json, 256));
+                                c_json_begin_read(json, input);
+                                assert(c_json_read_string_view(json, &string, &n) == C_JSON_E_INVALID_JSON);
+                                assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+                                json = c_json_free(json);
+
+                                input[offset + 1 + i] = 'x';
+                        }
+                }
+        }
+}
+
+static void test_space(void) {
+        static const char space[] = " \t\n\r";
+        static CJson *json = NULL;
+        char input[128];
+        uint64_t n;
+
+        /* runs of every length and alignment, ending in every whitespace character */
+        for (size_t offset = 0; offset < 16; offset += 1) {
+                for (size_t length = 0; length < 40; length += 1) {
+                        char *p = input;
+
+                        memset(p, ' ', offset);
+                        p += offset;
+                        *p++ = '[';
+                        for (size_t i = 0; i < length; i += 1)
+                                *p++ = space[(i + length) % 4];
+                        *p++ = '7';
+                        for (size_t i = 0; i < length; i += 1)
+                                *p++ = space[(i + offset) % 4];
+                        strcpy(p, "]");
+
+                        assert(!c_json_new(&json, 256));
+                        c_json_begin_read(json, input);
+                        assert(!c_json_open_array(json));
+                        assert(c_json_more(json));
+                        assert(!c_json_read_u64(json, &n));
+                        assert(n == 7);
+                        assert(!c_json_more(json));
+                        assert(!c_json_close_array(json));
+                        assert(!c_json_end_read(json));
+                        json = c_json_free(json);
+                }
+        }
+}
+
+typedef struct Feeder {
+        CJson *json;
+        const char *input;
+        size_t n_input;
+        size_t n_fed;
+        size_t n_chunk;
+        bool final;
+} Feeder;
+
+/* feeds the next chunk, or the end of input once everything was fed */
+static int feeder_next(Feeder *f) {
+        size_t n = c_min(f->n_chunk, f->n_input - f->n_fed);
+        int r;
+
+        if (f->final)
+                return 0;
+
+        r = c_json_feed(f->json, f->input + f->n_fed, n);
+        assert(r >= 0);
+        f->n_fed += n;
+        f->final = !n;
+
+        return n ? r : 0;
+}
+
+/* retries a reader until it has all the input it needs */
+#define FEED(_f, _call) ({                                                      \
+                int _r;                                                         \
+                while ((_r = (_call)) == C_JSON_E_AGAIN)                        \
+                        feeder_next(_f);                                        \
+                _r;                                                             \
+        })
+
+#define READ(_f, _call) ((_f) ? FEED((_f), _call) : (_call))
+
+/*
+ * Reads the next value and appends a description of it to @out, reading
+ * incrementally if @f is non-NULL.
+ */
+static int walk_value(CJson *json, Feeder *f, char *out) {
+        const char *string;
+        double f64;
+        size_t n;
+        bool b;
+        int r;
+
+        switch (c_json_peek(json)) {
+                case C_JSON_TYPE_NULL:
+                        r = READ(f, c_json_read_null(json));
+                        if (r)
+                                return r;
+                        strcat(out, "null ");
+                        return 0;
+
+                case C_JSON_TYPE_BOOLEAN:
+                        r = READ(f, c_json_read_bool(json, &b));
+                        if (r)
+                                return r;
+                        strcat(out, b ? "true " : "false ");
+                        return 0;
+
+                case C_JSON_TYPE_STRING:
+                        r = READ(f, c_json_read_string_view(json, &string, &n));
+                        if (r)
+                                return r;
+                        strcat(out, "'");
+                        strncat(out, string, n);
+                        strcat(out, "' ");
+                        return 0;
+
+                case C_JSON_TYPE_NUMBER:
+                        r = READ(f, c_json_read_f64(json, &f64));
+                        if (r)
+                                return r;
+                        sprintf(out + strlen(out), "%.17g ", f64);
+                        return 0;
+
+                case C_JSON_TYPE_ARRAY:
+                        r = READ(f, c_json_open_array(json));
+                        if (r)
+                                return r;
+                        strcat(out, "[ ");
+                        while (c_json_more(json)) {
+                                r = walk_value(json, f, out);
+                                if (r)
+                                        return r;
+                        }
+                        strcat(out, "] ");
+                        return READ(f, c_json_close_array(json));
+
+                case C_JSON_TYPE_OBJECT:
+                        r = READ(f, c_json_open_object(json));
+                        if (r)
+                                return r;
+                        strcat(out, "{ ");
+                        while (c_json_more(json)) {
+                                r = walk_value(json, f, out);
+                                if (r)
+                                        return r;
+                                r = walk_value(json, f, out);
+                                if (r)
+                                        return r;
+                        }
+                        strcat(out, "} ");
+                        return READ(f, c_json_close_object(json));
+
+                default:
+                        return -1;
+        }
+}
+
+static void test_feed(void) {
+        static const char *inputs[] = {
+                "  {\"key\": [ 1, -2.5e-3, 123456789, true, false, null ],\n"
+                "    \"esc\\u00e4\\ud83d\\ude00\\n\": \"value\", \"\": {}, \"x\": [[]] }\n",
+                "12345",
+                "[ \"abc\", 1e5 ] ",
+                "[ 1, 2 ",
+                "{ \"a\": tru }",
+                "[ \"a\\x\" ]",
+                "[ 1 2 ]",
+        };
+        static CJson *json = NULL;
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(inputs); i += 1) {
+                char expected[512] = "", out[512] = "";
+                size_t n_input = strlen(inputs[i]);
+                int r_expected;
+
+                assert(!c_json_new(&json, 256));
+                c_json_begin_read(json, inputs[i]);
+                walk_value(json, NULL, expected);
+                r_expected = c_json_end_read(json);
+                json = c_json_free(json);
+
+                /* with single bytes, this hits every split position */
+                for (size_t n_chunk = 1; n_chunk <= n_input; n_chunk += 1) {
+                        Feeder f = { .input = inputs[i], .n_input = n_input, .n_chunk = n_chunk };
+
+                        assert(!c_json_new(&json, 256));
+                        f.json = json;
+                        c_json_begin_feed(json);
+                        while (feeder_next(&f) == C_JSON_E_AGAIN)
+                                ;
+
+                        out[0] = '\0';
+                        walk_value(json, &f, out);
+                        while (!f.final)
+                                feeder_next(&f);
+
+                        assert(c_json_end_read(json) == r_expected);
+                        assert(!strcmp(out, expected));
+                        json = c_json_free(json);
+                }
+        }
+}
+
+static void test_read_n(void) {
+        static const struct {
+                const char *input;
+                size_t n_input;
+                int r;
+        } embedded[] = {
+                { "123\0", 4, C_JSON_E_INVALID_JSON },
+                { "[\0]", 3, C_JSON_E_INVALID_JSON },
+                { "\"a\0\"", 4, C_JSON_E_INVALID_JSON },
+                { "[1,\0 2]", 7, C_JSON_E_INVALID_JSON },
+                { "\"\\u00\0\"", 7, C_JSON_E_INVALID_JSON },
+        };
+        static const char *inputs[] = {
+                "{\"key\": [ 1, -2.5e-3, true, false, null ], \"\\u00e4\\n\": \"value\" }",
+                "\"a string that is longer than a single vector block\"",
+                "12345678901234567890123",
+                "  \t\n  ",
+        };
+        static CJson *json = NULL;
+        long page = sysconf(_SC_PAGESIZE);
+        char *map;
+
+        /* inputs end right in front of an inaccessible page */
+        map = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(map != MAP_FAILED);
+        assert(!mprotect(map + page, page, PROT_NONE));
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(inputs); i += 1) {
+                size_t n_input = strlen(inputs[i]);
+
+                /* every prefix, so each token is also cut off at the end */
+                for (size_t n = 0; n <= n_input; n += 1) {
+                        char expected[512] = "", out[512] = "", terminated[512];
+                        char *data = map + page - n;
+                        int r;
+
+                        memcpy(terminated, inputs[i], n);
+                        terminated[n] = '\0';
+                        memcpy(data, inputs[i], n);
+
+                        assert(!c_json_new(&json, 256));
+                        c_json_begin_read(json, terminated);
+                        walk_value(json, NULL, expected);
+                        r = c_json_end_read(json);
+                        json = c_json_free(json);
+
+                        assert(!c_json_new(&json, 256));
+                        c_json_begin_read_n(json, data, n);
+                        walk_value(json, NULL, out);
+                        assert(c_json_end_read(json) == r);
+                        assert(!strcmp(out, expected));
+                        json = c_json_free(json);
+                }
+        }
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(embedded); i += 1) {
+                char *data = map + page - embedded[i].n_input;
+
+                memcpy(data, embedded[i].input, embedded[i].n_input);
+
+                assert(!c_json_new(&json, 256));
+                c_json_begin_read_n(json, data, embedded[i].n_input);
+                walk_value(json, NULL, (char[512]){});
+                assert(c_json_end_read(json) == embedded[i].r);
+                json = c_json_free(json);
+        }
+
+        munmap(map, 2 * page);
+}
+
+static void test_skip(void) {
+        static const char *valid[] = {
+                "null",
+                "-12.5e+3",
+                "\"a \\\"quoted\\\" \\\\ [string] \\ud83d\\ude00\"",
+                "[]",
+                "{}",
+                "[ [], {}, [ [ 1 ] ] ]",
+                "{ \"a\": { \"b]\": [ true, false, \"}\" ] }, \"c\": [] }",
+        };
+        static const char *invalid[] = {
+                "nul",
+                "01",
+                "\"\\x\"",
+                "\"\\ud800\"",
+                "[ 1, ]",
+                "[ 1 }",
+                "{ \"a\" }",
+                "{ \"a\": 1, }",
+                "{ 1: 2 }",
+                "[ tru ]",
+        };
+        static CJson *json = NULL;
+        char input[512];
+        uint64_t u64;
+
+        for (size_t trusted = 0; trusted < 2; trusted += 1) {
+                for (size_t i = 0; i < C_ARRAY_SIZE(valid); i += 1) {
+                        assert(!c_json_new(&json, 256));
+                        c_json_set_flags(json, trusted ? C_JSON_FLAG_TRUSTED : 0);
+                        sprintf(input, "[ %s, 7 ]", valid[i]);
+                        c_json_begin_read(json, input);
+                        assert(!c_json_open_array(json));
+                        assert(!c_json_skip(json));
+                        assert(!c_json_read_u64(json, &u64));
+                        assert(u64 == 7);
+                        assert(!c_json_close_array(json));
+                        assert(!c_json_end_read(json));
+                        json = c_json_free(json);
+
+                        assert(!c_json_new(&json, 256));
+                        c_json_set_flags(json, trusted ? C_JSON_FLAG_TRUSTED : 0);
+                        sprintf(input, "{\"a\":%s,\"b\":7}", valid[i]);
+                        c_json_begin_read(json, input);
+                        assert(!c_json_open_object(json));
+                        assert(!c_json_skip(json));
+                        assert(!c_json_skip(json));
+                        assert(!c_json_read_string(json, NULL));
+                        assert(!c_json_read_u64(json, &u64));
+                        assert(u64 == 7);
+                        assert(c_json_skip(json) == C_JSON_E_INVALID_TYPE);
+                        json = c_json_free(json);
+                }
+        }
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(invalid); i += 1) {
+                assert(!c_json_new(&json, 256));
+                sprintf(input, "[ %s, 7 ]", invalid[i]);
+                c_json_begin_read(json, input);
+                assert(!c_json_open_array(json));
+                assert(c_json_skip(json) == C_JSON_E_INVALID_JSON);
+                assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+                json = c_json_free(json);
+        }
+
+        memset(input, '[', 200);
+        memset(input + 200, ']', 200);
+        input[400] = '\0';
+        assert(!c_json_new(&json, 100));
+        c_json_begin_read(json, input);
+        assert(c_json_skip(json) == C_JSON_E_DEPTH_OVERFLOW);
+        json = c_json_free(json);
+
+        /* a skip that runs out of input starts over once more is fed */
+        for (size_t trusted = 0; trusted < 2; trusted += 1) {
+                const char *doc = valid[C_ARRAY_SIZE(valid) - 1];
+                size_t n_doc = strlen(doc);
+
+                for (size_t n_chunk = 1; n_chunk <= n_doc; n_chunk += 1) {
+                        Feeder f = { .input = doc, .n_input = n_doc, .n_chunk = n_chunk };
+
+                        assert(!c_json_new(&json, 256));
+                        c_json_set_flags(json, trusted ? C_JSON_FLAG_TRUSTED : 0);
+                        f.json = json;
+                        c_json_begin_feed(json);
+                        while (feeder_next(&f) == C_JSON_E_AGAIN)
+                                ;
+
+                        assert(!FEED(&f, c_json_skip(json)));
+                        while (!f.final)
+                                feeder_next(&f);
+                        assert(!c_json_end_read(json));
+                        json = c_json_free(json);
+                }
+        }
+}
+
+static void test_find_key(void) {
+        static const char *doc = "{\"id\": 7, \"skip\": {\"name\": [1, \"}\"]}, \"na\\u006de\": \"v\", \"tags\": [1]}";
+        static const char *keys[] = { "tags", "id", "name" };
+        _c_cleanup_(c_json_key_set_freep) CJsonKeySet *set = NULL;
+        static CJson *json = NULL;
+        char input[4096], key[16], *p;
+        const char *key_p[200];
+        size_t index, n_doc = strlen(doc);
+        const char *string;
+        uint64_t u64;
+        bool found;
+        size_t n;
+
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, doc);
+        assert(!c_json_open_object(json));
+        assert(!c_json_find_key(json, "name", 4, &found));
+        assert(found);
+        assert(!c_json_read_string_view(json, &string, &n));
+        assert(n == 1 && string[0] == 'v');
+        /* keys are only searched for behind the current position */
+        assert(!c_json_find_key(json, "id", 2, &found));
+        assert(!found);
+        assert(!c_json_find_key(json, "id", 2, &found));
+        assert(!found);
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+        json = c_json_free(json);
+
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, "[ \"id\" ]");
+        assert(!c_json_open_array(json));
+        assert(c_json_find_key(json, "id", 2, &found) == C_JSON_E_INVALID_TYPE);
+        json = c_json_free(json);
+
+        assert(c_json_key_set_new(&set, (const char *[]){ "a", "b", "a" }, 3) == -EINVAL);
+        assert(!c_json_key_set_new(&set, NULL, 0));
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, doc);
+        assert(!c_json_open_object(json));
+        assert(!c_json_find_keys(json, set, &index));
+        assert(index == C_JSON_KEY_NONE);
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+        json = c_json_free(json);
+        set = c_json_key_set_free(set);
+
+        /* in feed mode, every split position resumes the search */
+        assert(!c_json_key_set_new(&set, keys, C_ARRAY_SIZE(keys)));
+        for (size_t n_chunk = 1; n_chunk <= n_doc; n_chunk += 1) {
+                Feeder f = { .input = doc, .n_input = n_doc, .n_chunk = n_chunk };
+                char out[64] = "";
+
+                assert(!c_json_new(&json, 256));
+                f.json = json;
+                c_json_begin_feed(json);
+                while (feeder_next(&f) == C_JSON_E_AGAIN)
+                        ;
+
+                assert(!FEED(&f, c_json_open_object(json)));
+                for (;;) {
+                        assert(!FEED(&f, c_json_find_keys(json, set, &index)));
+                        if (index == C_JSON_KEY_NONE)
+                                break;
+
+                        strcat(out, keys[index]);
+                        strcat(out, "=");
+                        assert(!walk_value(json, &f, out));
+                }
+                assert(!FEED(&f, c_json_close_object(json)));
+                while (!f.final)
+                        feeder_next(&f);
+                assert(!c_json_end_read(json));
+                assert(!strcmp(out, "id=7 name='v' tags=[ 1 ] "));
+                json = c_json_free(json);
+        }
+        set = c_json_key_set_free(set);
+
+        /* a larger set, with every key present in reverse order */
+        p = input;
+        p += sprintf(p, "{");
+        for (size_t i = 0; i < C_ARRAY_SIZE(key_p); i += 1) {
+                sprintf(key, "key-%zu", i);
+                key_p[i] = strdup(key);
+                p += sprintf(p, "%s\"key-%zu\": %zu", i ? ", " : "", C_ARRAY_SIZE(key_p) - 1 - i, C_ARRAY_SIZE(key_p) - 1 - i);
+        }
+        sprintf(p, "}");
+
+        assert(!c_json_key_set_new(&set, key_p, C_ARRAY_SIZE(key_p)));
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, input);
+        assert(!c_json_open_object(json));
+        for (size_t i = 0; i < C_ARRAY_SIZE(key_p); i += 1) {
+                assert(!c_json_find_keys(json, set, &index));
+                assert(index == C_ARRAY_SIZE(key_p) - 1 - i);
+                assert(!c_json_read_u64(json, &u64));
+                assert(u64 == index);
+        }
+        assert(!c_json_find_keys(json, set, &index));
+        assert(index == C_JSON_KEY_NONE);
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+        json = c_json_free(json);
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(key_p); i += 1)
+                free((char *)key_p[i]);
+}
+
+static void test_reset(void) {
+        _c_cleanup_(c_json_pool_freep) CJsonPool *pool = NULL;
+        static CJson *json = NULL;
+        CJson *first, *second;
+        uint64_t u64;
+
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, "[ 1, x ]");
+        assert(!c_json_open_array(json));
+        assert(!c_json_read_u64(json, &u64));
+        assert(c_json_read_u64(json, &u64) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        /* the error is gone, and so is the nesting level */
+        c_json_begin_read(json, "[ \"\\u00e4\", 2 ]");
+        assert(!c_json_open_array(json));
+        assert(!c_json_read_string(json, NULL));
+        assert(!c_json_read_u64(json, &u64));
+        assert(u64 == 2);
+        assert(!c_json_close_array(json));
+        assert(!c_json_end_read(json));
+
+        /* works on an idle reader, and in feed mode */
+        c_json_reset(json);
+        c_json_begin_feed(json);
+        assert(c_json_feed(json, "[ 1", 3) == 0);
+        c_json_reset(json);
+        c_json_begin_read(json, "3");
+        assert(!c_json_read_u64(json, &u64));
+        assert(u64 == 3);
+        assert(!c_json_end_read(json));
+        json = c_json_free(json);
+
+        assert(!c_json_pool_new(&pool, 4, 1));
+        assert(!c_json_pool_get(pool, &first));
+        assert(!c_json_pool_get(pool, &second));
+        assert(first != second);
+
+        /* trusted skipping does not track the depth */
+        c_json_set_flags(first, C_JSON_FLAG_TRUSTED);
+        c_json_begin_read(first, "[[[[[ 1 ]]]]]");
+        assert(!c_json_skip(first));
+        c_json_begin_read(second, "[[[[[ 1 ]]]]]");
+        assert(c_json_skip(second) == C_JSON_E_DEPTH_OVERFLOW);
+
+        /* the pool only keeps one, which comes back without its flags */
+        assert(!c_json_pool_put(pool, first));
+        assert(!c_json_pool_put(pool, second));
+        assert(!c_json_pool_get(pool, &json));
+        assert(json == first);
+        c_json_begin_read(json, "[[[[[ 1 ]]]]]");
+        assert(c_json_skip(json) == C_JSON_E_DEPTH_OVERFLOW);
+        json = c_json_pool_put(pool, json);
+}
+
+typedef struct Blocks {
+        char *blocks[16];
+        size_t n_blocks;
+} Blocks;
+
+static void *test_arena_grow(void *userdata, size_t n_min, size_t *np) {
+        Blocks *blocks = userdata;
+
+        assert(blocks->n_blocks < C_ARRAY_SIZE(blocks->blocks));
+        *np = c_max(n_min, (size_t)16);
+
+        return blocks->blocks[blocks->n_blocks++] = malloc(*np);
+}
+
+static void test_arena(void) {
+        static CJson *json = NULL;
+        Blocks blocks = {};
+        char arena[16], *s[4];
+
+        assert(!c_json_new(&json, 256));
+        c_json_set_arena(json, arena, sizeof(arena), test_arena_grow, &blocks);
+
+        /* the first two strings fit into the initial block */
+        c_json_begin_read(json, "[ \"first\", \"sec\\u006fnd\", \"third string\", \"\" ]");
+        assert(!c_json_open_array(json));
+        for (size_t i = 0; i < C_ARRAY_SIZE(s); i += 1)
+                assert(!c_json_read_string(json, &s[i]));
+        assert(!c_json_close_array(json));
+
+        assert(s[0] == arena && !strcmp(s[0], "first"));
+        assert(s[1] == arena + 6 && !strcmp(s[1], "second"));
+        assert(blocks.n_blocks == 1);
+        assert(s[2] == blocks.blocks[0] && !strcmp(s[2], "third string"));
+        assert(s[3] == blocks.blocks[0] + 13 && !strcmp(s[3], ""));
+        assert(!c_json_end_read(json));
+
+        /* the arena is rewound once reading has ended */
+        c_json_begin_read(json, "\"again\"");
+        assert(!c_json_read_string(json, &s[0]));
+        assert(s[0] == arena && !strcmp(s[0], "again"));
+        assert(!c_json_end_read(json));
+
+        /* without a callback, running out of space is fatal */
+        c_json_set_arena(json, arena, sizeof(arena), NULL, NULL);
+        c_json_begin_read(json, "\"a string that does not fit\"");
+        assert(c_json_read_string(json, &s[0]) == -ENOMEM);
+        assert(c_json_end_read(json) == -ENOMEM);
+        json = c_json_free(json);
+
+        for (size_t i = 0; i < blocks.n_blocks; i += 1)
+                free(blocks.blocks[i]);
+}
+
+static void test_inplace(void) {
+        static const char doc[] = "{\"k\\u00e4y\":[\"plain\",\"esc\\\"aped\\\\\",\"\\ud83d\\ude00\\t\",\"\"]}";
+        static CJson *json = NULL;
+        char input[sizeof(doc)], *s[5];
+        const char *view;
+        size_t n;
+
+        memcpy(input, doc, sizeof(doc));
+
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read_inplace(json, input, sizeof(doc) - 1);
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_string_view(json, &view, &n));
+        assert(n == 4 && !memcmp(view, "k\xc3\xa4y", n));
+        assert(view == input + 2);
+        assert(!c_json_open_array(json));
+        for (size_t i = 0; i < 4; i += 1)
+                assert(!c_json_read_string(json, &s[i]));
+        assert(!c_json_close_array(json));
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+        json = c_json_free(json);
+
+        /* everything points into the input, and survives the end of reading */
+        for (size_t i = 0; i < 4; i += 1)
+                assert(s[i] > input && s[i] < input + sizeof(input));
+        assert(!strcmp(s[0], "plain"));
+        assert(!strcmp(s[1], "esc\"aped\\"));
+        assert(!strcmp(s[2], "\xf0\x9f\x98\x80\t"));
+        assert(!strcmp(s[3], ""));
+}
+
+static void test_file(void) {
+        _c_cleanup_(c_fclosep) FILE *file = NULL;
+        static CJson *json = NULL;
+        char page[4096], *s;
+        int fds[2];
+        bool more;
+        size_t n;
+
+        assert(!c_json_new(&json, 256));
+
+        file = tmpfile();
+        assert(file);
+        assert(fputs("{ \"key\": [ 1, \"value\" ] }\n", file) >= 0);
+        assert(!fflush(file));
+
+        assert(!c_json_begin_read_file(json, fileno(file)));
+        assert((s = (char *)c_json_get_input(json, &n)));
+        assert(n == 26 && !memcmp(s, "{ \"key\"", 7));
+        assert(!c_json_open_object(json));
+        assert(!c_json_find_key(json, "key", 3, &more) && more);
+        assert(!c_json_open_array(json));
+        assert(!c_json_skip(json));
+        assert(!c_json_read_string(json, &s));
+        assert(!strcmp(s, "value"));
+        free(s);
+        assert(!c_json_close_array(json));
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+
+        /* a string that reaches the end of the last page */
+        memset(page, 'x', sizeof(page));
+        page[0] = '"';
+        page[sizeof(page) - 1] = '"';
+        assert(!ftruncate(fileno(file), 0));
+        assert(pwrite(fileno(file), page, sizeof(page), 0) == sizeof(page));
+        assert(!c_json_begin_read_file(json, fileno(file)));
+        assert(!c_json_read_string(json, &s));
+        assert(strlen(s) == sizeof(page) - 2);
+        free(s);
+        assert(!c_json_end_read(json));
+
+        /* an empty file holds no document */
+        assert(!ftruncate(fileno(file), 0));
+        assert(!c_json_begin_read_file(json, fileno(file)));
+        assert(!c_json_next_document(json, &more) && !more);
+        assert(!c_json_end_read(json));
+
+        /* pipes cannot be mapped */
+        assert(!pipe(fds));
+        assert(c_json_begin_read_file(json, fds[0]) == -ENODEV);
+        assert(!c_json_get_input(json, &n));
+        close(fds[0]);
+        close(fds[1]);
+
+        json = c_json_free(json);
+}
+
+static void test_index(void) {
+        static const char *inputs[] = {
+                "{\"key\": [ 1, -2.5e-3, true, null, \"a,b:c[d]{e}\" ], \"\\\\\": \"\\\\\\\"\", \"x\": [[{}]] }",
+                "[ \"................................................................\\\\\\\\\\\"\\\\\", "
+                "\"\\u00e4\\ud83d\\ude00\\n\\t\", \"\\/\\\\\\\\\\\\\" ]",
+                "\"unterminated \\\" string ]",
+                "[ \"raw \n control\" ]",
+                "{ \"a\": \"b\" \"c\": 1 }",
+                "[ \"\\\\\", \"\\\\\\\\\", \"\\\"\", 1 ] ]",
+        };
+        static CJson *json = NULL;
+        char buffer[512 + 64], expected[1024], out[1024];
+        int r, r_expected;
+
+        assert(!c_json_new(&json, 256));
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(inputs); i += 1) {
+                size_t n = strlen(inputs[i]);
+
+                assert(n < 512);
+
+                c_json_reset(json);
+                c_json_begin_read(json, inputs[i]);
+                *expected = '\0';
+                r_expected = walk_value(json, NULL, expected);
+                if (!r_expected)
+                        r_expected = c_json_end_read(json);
+
+                /* every alignment puts the escapes on a different block boundary */
+                for (size_t shift = 0; shift < 64; shift += 1) {
+                        char *input = (char *)(((uintptr_t)buffer + 63) & ~(uintptr_t)63) + shift;
+
+                        memcpy(input, inputs[i], n);
+
+                        c_json_reset(json);
+                        c_json_set_flags(json, C_JSON_FLAG_INDEX);
+                        c_json_begin_read_n(json, input, n);
+                        *out = '\0';
+                        r = walk_value(json, NULL, out);
+                        if (!r)
+                                r = c_json_end_read(json);
+                        assert(r == r_expected);
+                        assert(!strcmp(out, expected));
+
+                        c_json_reset(json);
+                        c_json_begin_read_n(json, input, n);
+                        r = c_json_skip(json);
+                        if (!r)
+                                r = c_json_end_read(json);
+                        assert(r == r_expected);
+
+                        c_json_reset(json);
+                        c_json_set_flags(json, C_JSON_FLAG_INDEX | C_JSON_FLAG_TRUSTED);
+                        c_json_begin_read_n(json, input, n);
+                        r = c_json_skip(json);
+                        if (!r_expected)
+                                assert(!r && !c_json_end_read(json));
+                        c_json_set_flags(json, 0);
+                }
+        }
+
+        json = c_json_free(json);
+}
+
+static void test_array_batch(void) {
+        static CJson *json = NULL;
+        uint64_t u64[4];
+        double f64[3];
+        size_t n;
+
+        assert(!c_json_new(&json, 256));
+
+        /* read in chunks, until the array ends */
+        c_json_begin_read(json, "[ 1, 2 ,3,\n4, 5, 18446744073709551615 ]");
+        assert(!c_json_open_array(json));
+        assert(!c_json_read_u64_array(json, u64, 4, &n));
+        assert(n == 4 && u64[0] == 1 && u64[3] == 4);
+        assert(c_json_more(json));
+        assert(!c_json_read_u64_array(json, u64, 4, &n));
+        assert(n == 2 && u64[0] == 5 && u64[1] == UINT64_MAX);
+        assert(!c_json_more(json));
+        assert(!c_json_read_u64_array(json, u64, 4, &n));
+        assert(n == 0);
+        assert(!c_json_close_array(json));
+        assert(!c_json_end_read(json));
+
+        c_json_begin_read(json, "{ \"x\": [ -1.5, 2e3, 0 ], \"y\": [] }");
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_string(json, NULL));
+        assert(!c_json_open_array(json));
+        assert(!c_json_read_f64_array(json, f64, 3, &n));
+        assert(n == 3 && f64[0] == -1.5 && f64[1] == 2000 && f64[2] == 0);
+        assert(!c_json_close_array(json));
+        assert(!c_json_read_string(json, NULL));
+        assert(!c_json_open_array(json));
+        assert(!c_json_read_f64_array(json, f64, 3, &n));
+        assert(n == 0);
+        assert(!c_json_close_array(json));
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+
+        /* errors report what was read before */
+        c_json_reset(json);
+        c_json_begin_read(json, "[ 1, -2 ]");
+        assert(!c_json_open_array(json));
+        assert(c_json_read_u64_array(json, u64, 4, &n) == C_JSON_E_INVALID_TYPE);
+        assert(n == 1 && u64[0] == 1);
+        c_json_reset(json);
+
+        c_json_begin_read(json, "[ 1, 2, ]");
+        assert(!c_json_open_array(json));
+        assert(c_json_read_f64_array(json, f64, 3, &n) == C_JSON_E_INVALID_TYPE);
+        assert(n == 2);
+        c_json_reset(json);
+
+        c_json_begin_read(json, "[ 1 2 ]");
+        assert(!c_json_open_array(json));
+        assert(c_json_read_f64_array(json, f64, 3, &n) == C_JSON_E_INVALID_JSON);
+        assert(n == 0);
+        c_json_reset(json);
+
+        c_json_begin_read(json, "1");
+        assert(c_json_read_f64_array(json, f64, 3, &n) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        /* in feed mode, a partial batch is kept and the rest is retried */
+        c_json_begin_feed(json);
+        assert(!c_json_feed(json, "[ 1, 2, 3", 9));
+        assert(!c_json_open_array(json));
+        assert(!c_json_read_u64_array(json, u64, 4, &n));
+        assert(n == 2 && u64[1] == 2);
+        assert(c_json_read_u64_array(json, u64, 4, &n) == C_JSON_E_AGAIN);
+        assert(n == 0);
+        assert(!c_json_feed(json, "0 ]", 3));
+        assert(!c_json_feed(json, NULL, 0));
+        assert(!c_json_read_u64_array(json, u64, 4, &n));
+        assert(n == 1 && u64[0] == 30);
+        assert(!c_json_close_array(json));
+        assert(!c_json_end_read(json));
+        json = c_json_free(json);
+}
+
+static void test_documents(void) {
+        static const char input[] = " 1 2\n{\"a\": [ true ]}[3]\"s\" null\n";
+        static const struct {
+                const char *input;
+                const char *out;
+        } separators[] = {
+                { "1[2]", "1 [ 2 ] " },
+                { "\"s\"{}[]3", "'s' { } [ ] 3 " },
+                { "1-2", NULL },
+                { "1.5e3-1", NULL },
+                { "truefalse", NULL },
+                { "nulltrue", NULL },
+                { "\"a\"\"b\"", NULL },
+                { "[1]2\"s\"", NULL },
+        };
+        static CJson *json = NULL;
+        char out[256] = "";
+        bool more;
+        int r;
+
+        assert(!c_json_new(&json, 256));
+        c_json_begin_read(json, input);
+        for (;;) {
+                assert(!c_json_next_document(json, &more));
+                if (!more)
+                        break;
+                assert(!walk_value(json, NULL, out));
+        }
+        assert(!c_json_end_read(json));
+        assert(!strcmp(out, "1 2 { 'a' [ true ] } [ 3 ] 's' null "));
+
+        /* every split position, in feed mode */
+        for (size_t n_chunk = 1; n_chunk <= strlen(input); n_chunk += 1) {
+                Feeder f = { .json = json, .input = input, .n_input = strlen(input), .n_chunk = n_chunk };
+                int r;
+
+                *out = '\0';
+                c_json_begin_feed(json);
+                while (feeder_next(&f) == C_JSON_E_AGAIN)
+                        ;
+                for (;;) {
+                        r = FEED(&f, c_json_next_document(json, &more));
+                        assert(!r);
+                        if (!more)
+                                break;
+                        assert(!walk_value(json, &f, out));
+                }
+                assert(!c_json_end_read(json));
+                assert(!strcmp(out, "1 2 { 'a' [ true ] } [ 3 ] 's' null "));
+        }
+
+        /* anything but a container must be separated from a scalar in front of it */
+        for (size_t i = 0; i < C_ARRAY_SIZE(separators); i += 1) {
+                for (size_t n_chunk = 0; n_chunk <= strlen(separators[i].input); n_chunk += 1) {
+                        Feeder f = {
+                                .json = json,
+                                .input = separators[i].input,
+                                .n_input = strlen(separators[i].input),
+                                .n_chunk = n_chunk,
+                        };
+                        Feeder *fp = n_chunk ? &f : NULL;
+
+                        *out = '\0';
+                        if (fp) {
+                                c_json_begin_feed(json);
+                                while (feeder_next(&f) == C_JSON_E_AGAIN)
+                                        ;
+                        } else {
+                                c_json_begin_read(json, separators[i].input);
+                        }
+
+                        for (;;) {
+                                r = READ(fp, c_json_next_document(json, &more));
+                                if (r || !more)
+                                        break;
+                                r = walk_value(json, fp, out);
+                                if (r)
+                                        break;
+                        }
+
+                        if (separators[i].out) {
+                                assert(!r);
+                                assert(!c_json_end_read(json));
+                                assert(!strcmp(out, separators[i].out));
+                        } else {
+                                assert(r == C_JSON_E_INVALID_JSON);
+                                assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+                                c_json_reset(json);
+                        }
+                }
+        }
+
+        /* only between documents */
+        c_json_begin_read(json, "[ 1 ] [");
+        assert(!c_json_next_document(json, &more) && more);
+        assert(!c_json_open_array(json));
+        assert(c_json_next_document(json, &more) == C_JSON_E_INVALID_TYPE);
+        assert(c_json_end_read(json) == C_JSON_E_INVALID_TYPE);
+        json = c_json_free(json);
+}
+
+typedef struct Records {
+        uint64_t sum;
+        size_t n_records;
+} Records;
+
+static int test_dispatch_record(void *userdata, CJson *json, size_t offset) {
+        Records *records = userdata;
+        uint64_t id;
+        bool found;
+        int r;
+
+        r = c_json_open_object(json);
+        if (!r)
+                r = c_json_find_key(json, "id", 2, &found);
+        if (!r && found)
+                r = c_json_read_u64(json, &id);
+        while (!r && c_json_more(json))
+                r = c_json_skip(json);
+        if (!r)
+                r = c_json_close_object(json);
+        if (!r)
+                r = c_json_end_read(json);
+        if (r)
+                return r;
+
+        __atomic_add_fetch(&records->sum, id, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&records->n_records, 1, __ATOMIC_RELAXED);
+
+        return 0;
+}
+
+static void test_dispatch(void) {
+        char input[64 * 1024], *p = input;
+        Records records;
+
+        for (size_t i = 1; i <= 1000; i += 1) {
+                p += sprintf(p, i % 7 ? "{\"id\": %zu, \"s\": \"a\\nb\"}\n" : "\n  {\"x\": [], \"id\": %zu}\r\n", i);
+                assert(p < input + sizeof(input) - 64);
+        }
+
+        for (size_t n_workers = 1; n_workers <= 8; n_workers *= 2) {
+                records = (Records){};
+                assert(!c_json_dispatch_lines(input, p - input, n_workers, 16, 0, test_dispatch_record, &records));
+                assert(records.sum == 1000 * 1001 / 2);
+                assert(records.n_records == 1000);
+        }
+
+        /* the first record that fails decides */
+        memcpy(strstr(input, "{\"id\": 500,"), "{\"id\": 500 ", 11);
+        memcpy(strstr(input, "{\"id\": 900,"), "{\"id\": -900", 11);
+        for (size_t n_workers = 1; n_workers <= 8; n_workers *= 2) {
+                records = (Records){};
+                assert(c_json_dispatch_lines(input, p - input, n_workers, 16, 0, test_dispatch_record, &records) == C_JSON_E_INVALID_JSON);
+                assert(records.n_records < 1000);
+        }
+
+        assert(c_json_dispatch_lines(input, p - input, 0, 16, 0, test_dispatch_record, &records) == -EINVAL);
+}
+
+typedef struct Sink {
+        char data[8192];
+        size_t n_data;
+        size_t n_calls;
+} Sink;
+
+static int test_write_flush(void *userdata, const char *data, size_t n_data) {
+        Sink *sink = userdata;
+
+        assert(sink->n_data + n_data <= sizeof(sink->data));
+        memcpy(sink->data + sink->n_data, data, n_data);
+        sink->n_data += n_data;
+        sink->n_calls += 1;
+
+        return 0;
+}
+
+static void test_write_f64(CJson *json, double f64, const char *expected) {
+        char *output;
+        double parsed;
+
+        c_json_begin_write(json, NULL, NULL);
+        assert(!c_json_write_f64(json, f64));
+        assert(!c_json_end_write(json, &output, NULL));
+        assert(!strcmp(output, expected));
+
+        /* the shortest form still reads back as the same number */
+        c_json_begin_read(json, output);
+        assert(!c_json_read_f64(json, &parsed));
+        assert(!c_json_end_read(json));
+        assert(parsed == f64 && signbit(parsed) == signbit(f64));
+        free(output);
+}
+
+static void test_write(void) {
+        static const char doc[] = "{\"a\":[null,true,false,-9223372036854775808,18446744073709551615,0.5],"
+                                  "\"b\\\"\\\\\\n\\t\\u0001\":{},\"c\":[[]],\"\":\"\xc3\xa4\"}";
+        static CJson *json = NULL;
+        char *output, *s;
+        Sink sink = {};
+        size_t n;
+
+        assert(!c_json_new(&json, 4));
+
+        c_json_begin_write(json, NULL, NULL);
+        assert(!c_json_write_open_object(json));
+        assert(!c_json_write_string(json, "a"));
+        assert(!c_json_write_open_array(json));
+        assert(!c_json_write_null(json));
+        assert(!c_json_write_bool(json, true));
+        assert(!c_json_write_bool(json, false));
+        assert(!c_json_write_i64(json, INT64_MIN));
+        assert(!c_json_write_u64(json, UINT64_MAX));
+        assert(!c_json_write_f64(json, 0.5));
+        assert(!c_json_write_close_array(json));
+        assert(!c_json_write_string_n(json, "b\"\\\n\t\x01", 6));
+        assert(!c_json_write_open_object(json));
+        assert(!c_json_write_close_object(json));
+        assert(!c_json_write_string(json, "c"));
+        assert(!c_json_write_open_array(json));
+        assert(!c_json_write_open_array(json));
+        assert(!c_json_write_close_array(json));
+        assert(!c_json_write_close_array(json));
+        assert(!c_json_write_string_n(json, NULL, 0));
+        assert(!c_json_write_string(json, "\xc3\xa4"));
+        assert(!c_json_write_close_object(json));
+        assert(!c_json_end_write(json, &output, &n));
+        assert(n == strlen(doc) && !strcmp(output, doc));
+
+        /* what was written reads back */
+        c_json_begin_read(json, output);
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_string(json, &s));
+        assert(!strcmp(s, "a"));
+        free(s);
+        assert(!c_json_skip(json));
+        assert(!c_json_read_string(json, &s));
+        assert(!strcmp(s, "b\"\\\n\t\x01"));
+        free(s);
+        assert(!c_json_skip(json));
+        assert(!c_json_skip(json));
+        assert(!c_json_skip(json));
+        assert(!c_json_skip(json));
+        assert(!c_json_skip(json));
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+        free(output);
+
+        test_write_f64(json, 0.1, "0.1");
+        test_write_f64(json, 123.0, "123");
+        test_write_f64(json, -0.0, "-0");
+        test_write_f64(json, 1e21, "1e21");
+        test_write_f64(json, 1.5e-7, "1.5e-7");
+        test_write_f64(json, 0.000015, "0.000015");
+        test_write_f64(json, 5e-324, "5e-324");
+        test_write_f64(json, 1.7976931348623157e308, "1.7976931348623157e308");
+        test_write_f64(json, 1.0 / 3.0, "0.3333333333333333");
+        test_write_f64(json, 1e23, "1e23");
+        test_write_f64(json, 1e-323, "1e-323");
+        test_write_f64(json, 2.2250738585072014e-308, "2.2250738585072014e-308");
+        test_write_f64(json, 0x1p-1017, "7.120236347223045e-307");
+
+        /* misuse poisons the writer, and ending discards the output */
+        c_json_begin_write(json, NULL, NULL);
+        assert(!c_json_write_open_object(json));
+        assert(c_json_write_u64(json, 1) == C_JSON_E_INVALID_TYPE);
+        assert(c_json_write_string(json, "k") == C_JSON_E_INVALID_TYPE);
+        assert(c_json_end_write(json, &output, NULL) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        c_json_begin_write(json, NULL, NULL);
+        assert(!c_json_write_open_object(json));
+        assert(!c_json_write_string(json, "k"));
+        assert(c_json_write_close_object(json) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        c_json_begin_write(json, NULL, NULL);
+        assert(!c_json_write_null(json));
+        assert(c_json_write_null(json) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        c_json_begin_write(json, NULL, NULL);
+        assert(c_json_write_f64(json, NAN) == C_JSON_E_OUT_OF_RANGE);
+        c_json_reset(json);
+
+        c_json_begin_write(json, NULL, NULL);
+        assert(c_json_end_write(json, &output, NULL) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        c_json_begin_write(json, NULL, NULL);
+        for (size_t i = 0; i < 4; i += 1)
+                assert(!c_json_write_open_array(json));
+        assert(c_json_write_open_array(json) == C_JSON_E_DEPTH_OVERFLOW);
+        c_json_reset(json);
+
+        /* a flush callback receives the output in chunks */
+        c_json_begin_write(json, test_write_flush, &sink);
+        assert(!c_json_write_open_array(json));
+        for (size_t i = 0; i < 1000; i += 1)
+                assert(!c_json_write_u64(json, 1000 + i));
+        assert(!c_json_write_close_array(json));
+        assert(sink.n_calls == 1);
+        assert(!c_json_end_write(json, NULL, NULL));
+        assert(sink.n_calls == 2);
+        assert(sink.n_data == 2 + 1000 * 5 - 1);
+        assert(!memcmp(sink.data, "[1000,1001,", 11) && !memcmp(sink.data + sink.n_data - 6, ",1999]", 6));
+        json = c_json_free(json);
+}
+
+static void test_stats(void) {
+        static const char input[] = "{ \"a\": [ 1, 2.5, true, null ],\n  \"b\\n\": { \"c\": [] }, \"d\": \"x\" }";
+        static CJson *json = NULL;
+        CJsonStats stats;
+        bool found;
+        int r;
+
+        assert(!c_json_new(&json, 256));
+
+        c_json_begin_read(json, input);
+        assert(!c_json_open_object(json));
+        assert(!c_json_find_key(json, "b\n", 2, &found) && found);
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_string_view(json, NULL, NULL));
+        assert(!c_json_open_array(json));
+        assert(!c_json_close_array(json));
+        assert(!c_json_close_object(json));
+        assert(!c_json_read_string_view(json, NULL, NULL));
+        assert(!c_json_read_string(json, NULL));
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+
+        r = c_json_get_stats(json, &stats);
+        if (r == -ENOTSUP) {
+                assert(!stats.n_bytes && !stats.max_depth);
+                json = c_json_free(json);
+                return;
+        }
+
+        assert(!r);
+        assert(stats.n_bytes == strlen(input));
+        assert(stats.n_values[C_JSON_TYPE_OBJECT] == 2);
+        assert(stats.n_values[C_JSON_TYPE_ARRAY] == 1);
+        assert(stats.n_values[C_JSON_TYPE_STRING] == 3);
+        assert(stats.n_values[C_JSON_TYPE_NUMBER] == 0);
+        assert(stats.n_skipped == 1);
+        assert(stats.n_strings_decoded == 1);
+        assert(stats.n_strings_borrowed == 4);
+        assert(stats.n_escapes == 1);
+        assert(stats.max_depth == 3);
+
+        /* the counters restart with the next read, and cover it while it runs */
+        c_json_begin_read(json, "[ 1, 2 ]");
+        assert(!c_json_open_array(json));
+        assert(!c_json_read_u64(json, NULL));
+        assert(!c_json_get_stats(json, &stats));
+        assert(stats.n_bytes == 5);
+        assert(stats.n_values[C_JSON_TYPE_NUMBER] == 1);
+        assert(stats.n_space == 2);
+        assert(stats.max_depth == 1);
+        assert(!c_json_read_u64(json, NULL));
+        assert(!c_json_close_array(json));
+        assert(!c_json_end_read(json));
+
+        json = c_json_free(json);
+}
+
+static void test_doc(void) {
+        static const char input[] = "{ \"route\": \"a\", \"n\": [ 1, -2, { \"x\": 2.5 } ], \"k\\u00e4y\": \"e\\n\", "
+                                    "\"b\": true, \"z\": null, \"e\": {}, \"l\": [] } [ 7 ]";
+        _c_cleanup_(c_json_doc_freep) CJsonDoc *doc = NULL;
+        static CJson *json = NULL;
+        size_t i, n, end;
+        const char *s;
+        uint64_t u64;
+        int64_t i64;
+        double f64;
+        bool b;
+
+        assert(!c_json_new(&json, 256));
+        assert(!c_json_doc_new(&doc));
+
+        c_json_begin_read(json, input);
+        assert(!c_json_doc_read(doc, json));
+
+        /* the reader is behind the object */
+        assert(c_json_peek(json) == C_JSON_TYPE_ARRAY);
+
+        assert(c_json_doc_type(doc, 0) == C_JSON_TYPE_OBJECT);
+        assert(c_json_doc_length(doc, 0) == 7);
+
+        i = c_json_doc_find_key(doc, 0, "route", 5);
+        assert(i != C_JSON_KEY_NONE && c_json_doc_type(doc, i) == C_JSON_TYPE_STRING);
+        assert(!c_json_doc_get_string(doc, i, &s, &n));
+        assert(n == 1 && s == input + 12);
+
+        i = c_json_doc_find_key(doc, 0, "n", 1);
+        assert(c_json_doc_type(doc, i) == C_JSON_TYPE_ARRAY);
+        assert(c_json_doc_length(doc, i) == 3);
+        end = c_json_doc_next(doc, i);
+        i = c_json_doc_child(doc, i);
+        assert(!c_json_doc_get_u64(doc, i, &u64) && u64 == 1);
+        i = c_json_doc_next(doc, i);
+        assert(c_json_doc_get_u64(doc, i, &u64) == C_JSON_E_INVALID_TYPE);
+        assert(!c_json_doc_get_i64(doc, i, &i64) && i64 == -2);
+        i = c_json_doc_next(doc, i);
+        assert(c_json_doc_type(doc, i) == C_JSON_TYPE_OBJECT);
+        assert(!c_json_doc_get_f64(doc, c_json_doc_find_key(doc, i, "x", 1), &f64) && f64 == 2.5);
+        assert(c_json_doc_next(doc, i) == end);
+        assert(c_json_doc_find_key(doc, 0, "x", 1) == C_JSON_KEY_NONE);
+
+        /* keys are compared decoded, strings are decoded on access */
+        i = c_json_doc_find_key(doc, 0, "k\xc3\xa4y", 4);
+        assert(!c_json_doc_get_string(doc, i, &s, &n));
+        assert(n == 2 && !memcmp(s, "e\n", 2));
+
+        assert(!c_json_doc_get_bool(doc, c_json_doc_find_key(doc, 0, "b", 1), &b) && b);
+        assert(c_json_doc_type(doc, c_json_doc_find_key(doc, 0, "z", 1)) == C_JSON_TYPE_NULL);
+
+        i = c_json_doc_find_key(doc, 0, "e", 1);
+        assert(c_json_doc_length(doc, i) == 0);
+        assert(c_json_doc_child(doc, i) == c_json_doc_next(doc, i));
+        i = c_json_doc_find_key(doc, 0, "l", 1);
+        assert(c_json_doc_length(doc, i) == 0);
+        assert(c_json_doc_next(doc, i) == c_json_doc_next(doc, 0));
+
+        /* a value within a container, which replaces the document */
+        assert(!c_json_open_array(json));
+        assert(!c_json_doc_read(doc, json));
+        assert(!c_json_doc_get_u64(doc, 0, &u64) && u64 == 7);
+        assert(c_json_doc_next(doc, 0) == 1);
+        assert(!c_json_close_array(json));
+        assert(!c_json_end_read(json));
+
+        /* failures poison the reader */
+        c_json_begin_read(json, "[ 1, { \"a\": tru } ]");
+        assert(c_json_doc_read(doc, json) == C_JSON_E_INVALID_JSON);
+        assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+        c_json_reset(json);
+
+        c_json_begin_read(json, "{ \"a\": 1 }");
+        assert(!c_json_open_object(json));
+        assert(c_json_doc_read(doc, json) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        /* a key without a value is never recorded */
+        c_json_begin_read(json, "{ \"k1\": 1, \"k3\": }");
+        assert(c_json_doc_read(doc, json) == C_JSON_E_INVALID_JSON);
+        assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+        c_json_reset(json);
+
+        c_json_begin_read(json, "[ { \"k\": ] ]");
+        assert(c_json_doc_read(doc, json) == C_JSON_E_INVALID_JSON);
+        c_json_reset(json);
+
+        json = c_json_free(json);
+}
+
+static int test_paths_record(void *userdata, CJson *json, size_t index) {
+        char *out = userdata;
+        const char *s;
+        uint64_t u64;
+        size_t n;
+
+        switch (c_json_peek(json)) {
+                case C_JSON_TYPE_NUMBER:
+                        assert(!c_json_read_u64(json, &u64));
+                        sprintf(out + strlen(out), "%zu=%" PRIu64 " ", index, u64);
+                        break;
+                case C_JSON_TYPE_STRING:
+                        assert(!c_json_read_string_view(json, &s, &n));
+                        sprintf(out + strlen(out), "%zu=%.*s ", index, (int)n, s);
+                        break;
+                default:
+                        assert(!c_json_skip(json));
+                        sprintf(out + strlen(out), "%zu=? ", index);
+                        break;
+        }
+
+        return strstr(out, "stop") ? 42 : 0;
+}
+
+static void test_paths(void) {
+        static const char input[] = "{ \"user\": { \"name\": \"x\", \"id\": 7 }, \"events\": [ { \"ts\": 1 },"
+                                    " { \"x\": { \"ts\": 9 }, \"ts\": 2 } ], \"meta\": { \"region\": \"eu\" },"
+                                    " \"other\": [ 11, 12, 13 ], \"a/b\": [ true ] }";
+        static const char * const paths[] = {
+                "/user/id",
+                "/events/*/ts",
+                "/meta/region",
+                "/events/1/x",
+                "/other/1",
+                "/a~1b/0",
+        };
+        _c_cleanup_(c_json_paths_freep) CJsonPaths *set = NULL;
+        static CJson *json = NULL;
+        char out[256] = "";
+
+        assert(!c_json_new(&json, 256));
+        assert(!c_json_paths_new(&set, paths, C_ARRAY_SIZE(paths)));
+
+        c_json_begin_read(json, input);
+        assert(!c_json_find_paths(json, set, test_paths_record, out));
+        assert(!c_json_end_read(json));
+        assert(!strcmp(out, "0=7 1=1 3=? 1=2 2=eu 4=12 5=? "));
+
+        /* the same, with trusted skipping */
+        *out = '\0';
+        c_json_set_flags(json, C_JSON_FLAG_TRUSTED);
+        c_json_begin_read(json, input);
+        assert(!c_json_find_paths(json, set, test_paths_record, out));
+        assert(!c_json_end_read(json));
+        assert(!strcmp(out, "0=7 1=1 3=? 1=2 2=eu 4=12 5=? "));
+        c_json_set_flags(json, 0);
+        set = c_json_paths_free(set);
+
+        /* the root, and values within matches */
+        *out = '\0';
+        assert(!c_json_paths_new(&set, (const char *[]){ "/user/id", "", "/user" }, 3));
+        c_json_begin_read(json, input);
+        assert(!c_json_find_paths(json, set, test_paths_record, out));
+        assert(!c_json_end_read(json));
+        assert(!strcmp(out, "1=? "));
+        set = c_json_paths_free(set);
+
+        /* failures and callback results are passed on */
+        assert(!c_json_paths_new(&set, (const char *[]){ "/*" }, 1));
+        *out = '\0';
+        c_json_begin_read(json, "[ \"go\", \"stop\", \"never\" ]");
+        assert(c_json_find_paths(json, set, test_paths_record, out) == 42);
+        assert(!strcmp(out, "0=go 0=stop "));
+        c_json_reset(json);
+        set = c_json_paths_free(set);
+        assert(!c_json_paths_new(&set, (const char *[]){ "/*/b" }, 1));
+        *out = '\0';
+        c_json_begin_read(json, "[ { \"a\": 1, \"b\": 2 }, tru ]");
+        assert(c_json_find_paths(json, set, test_paths_record, out) == C_JSON_E_INVALID_JSON);
+        assert(!strcmp(out, "0=2 "));
+        c_json_reset(json);
+        set = c_json_paths_free(set);
+
+        assert(c_json_paths_new(&set, (const char *[]){ "user" }, 1) == -EINVAL);
+        assert(c_json_paths_new(&set, (const char *[]){ "/a~2" }, 1) == -EINVAL);
+
+        json = c_json_free(json);
+}
+
+typedef struct TestInner {
+        uint64_t x;
+        char *tag;
+} TestInner;
+
+typedef struct TestMessage {
+        uint64_t id;
+        int64_t delta;
+        double score;
+        bool active;
+        char *name;
+        TestInner inner;
+} TestMessage;
+
+/* nested offsets are relative to the nested struct */
+static const CJsonField test_message_inner[] = {
+        C_JSON_FIELD("x", C_JSON_FIELD_U64, TestInner, x),
+        C_JSON_FIELD("tag", C_JSON_FIELD_STRING, TestInner, tag),
+};
+
+static const CJsonField test_message[] = {
+        C_JSON_FIELD("id", C_JSON_FIELD_U64, TestMessage, id),
+        C_JSON_FIELD("delta", C_JSON_FIELD_I64, TestMessage, delta),
+        C_JSON_FIELD("score", C_JSON_FIELD_F64, TestMessage, score),
+        C_JSON_FIELD("active", C_JSON_FIELD_BOOL, TestMessage, active),
+        C_JSON_FIELD("name", C_JSON_FIELD_STRING, TestMessage, name),
+        C_JSON_FIELD_NESTED("inner", TestMessage, inner, test_message_inner),
+};
+
+static void test_struct(void) {
+        static const char doc[] = "{ \"skip\": [ 1, { \"id\": 3 } ], \"id\": 7, \"name\": \"n\\u00e4me\", \"delta\": -3,"
+                                  " \"inner\": { \"tag\": \"t\", \"y\": null, \"x\": 9 }, \"active\": true }";
+        _c_cleanup_(c_json_struct_freep) CJsonStruct *desc = NULL;
+        static CJson *json = NULL;
+        char input[sizeof(doc)], arena[64];
+        TestMessage m;
+
+        assert(!c_json_new(&json, 256));
+        assert(!c_json_struct_new(&desc, test_message, C_ARRAY_SIZE(test_message)));
+
+        /* fields that do not appear keep their values */
+        m = (TestMessage){ .score = 0.5 };
+        c_json_begin_read(json, doc);
+        assert(!c_json_read_struct(json, desc, &m));
+        assert(!c_json_end_read(json));
+        assert(m.id == 7 && m.delta == -3 && m.score == 0.5 && m.active);
+        assert(!strcmp(m.name, "n\xc3\xa4me"));
+        assert(m.inner.x == 9 && !strcmp(m.inner.tag, "t"));
+        free(m.inner.tag);
+        free(m.name);
+
+        /* in place, strings are borrowed from the input */
+        memcpy(input, doc, sizeof(doc));
+        m = (TestMessage){};
+        c_json_begin_read_inplace(json, input, sizeof(doc) - 1);
+        assert(!c_json_read_struct(json, desc, &m));
+        assert(!c_json_end_read(json));
+        assert(m.name > input && m.name < input + sizeof(input) && !strcmp(m.name, "n\xc3\xa4me"));
+        assert(m.inner.tag > input && m.inner.tag < input + sizeof(input));
+
+        /* from an arena, nothing is allocated either */
+        m = (TestMessage){};
+        c_json_set_arena(json, arena, sizeof(arena), NULL, NULL);
+        c_json_begin_read(json, doc);
+        assert(!c_json_read_struct(json, desc, &m));
+        assert(m.name >= arena && m.name < arena + sizeof(arena));
+        assert(!c_json_end_read(json));
+        c_json_set_arena(json, NULL, 0, NULL, NULL);
+
+        /* values must have the type of their field */
+        m = (TestMessage){};
+        c_json_begin_read(json, "{ \"inner\": { \"x\": -1 } }");
+        assert(c_json_read_struct(json, desc, &m) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+        c_json_begin_read(json, "[ 1 ]");
+        assert(c_json_read_struct(json, desc, &m) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        desc = c_json_struct_free(desc);
+        assert(c_json_struct_new(&desc, (const CJsonField[]){
+                C_JSON_FIELD("id", C_JSON_FIELD_U64, TestMessage, id),
+                C_JSON_FIELD("id", C_JSON_FIELD_I64, TestMessage, delta),
+        }, 2) == -EINVAL);
+
+        json = c_json_free(json);
+}
+
+static void test_symbols(void) {
+        _c_cleanup_(c_json_symbols_freep) CJsonSymbols *symbols = NULL;
+        const char *key, *first;
+        static CJson *json = NULL;
+        size_t id, n;
+        char name[16];
+
+        assert(!c_json_new(&json, 256));
+        assert(!c_json_symbols_new(&symbols, 2));
+        assert(!c_json_symbols_add(symbols, "id", 2, &id) && id == 0);
+        c_json_set_symbols(json, symbols);
+
+        /* repeated keys resolve to the same copy, escapes are decoded first */
+        c_json_begin_read(json, "[ { \"id\": 1, \"n\\u0061me\": 2 }, { \"name\": 3, \"id\": 4 } ]");
+        assert(!c_json_open_array(json));
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_key(json, &key, &id) && id == 0 && !strcmp(key, "id"));
+        assert(!c_json_skip(json));
+        assert(!c_json_read_key(json, &first, &id) && id == 1 && !strcmp(first, "name"));
+        assert(!c_json_skip(json));
+        assert(c_json_read_key(json, &key, &id) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        c_json_begin_read(json, "{ \"name\": 3, \"other\": 4, \"id\": \"id\" }");
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_key(json, &key, &id) && id == 1 && key == first);
+
+        /* the table is full, so new keys are not added */
+        assert(!c_json_skip(json));
+        assert(!c_json_read_key(json, &key, &id) && id == C_JSON_KEY_NONE && !key);
+        assert(!c_json_skip(json));
+        assert(!c_json_read_key(json, NULL, &id) && id == 0);
+        assert(c_json_read_key(json, &key, &id) == C_JSON_E_INVALID_TYPE);
+        c_json_reset(json);
+
+        assert(c_json_symbols_count(symbols) == 2);
+        assert(!strcmp(c_json_symbols_get(symbols, 1, &n), "name") && n == 4);
+        assert(!c_json_symbols_get(symbols, 2, NULL));
+        assert(c_json_symbols_add(symbols, "other", 5, NULL) == -ENOSPC);
+
+        /* growing keeps IDs and strings, frozen tables are not written to */
+        symbols = c_json_symbols_free(symbols);
+        assert(!c_json_symbols_new(&symbols, SIZE_MAX));
+        for (size_t i = 0; i < 1000; i += 1) {
+                snprintf(name, sizeof(name), "key%zu", i);
+                assert(!c_json_symbols_add(symbols, name, strlen(name), &id) && id == i);
+                if (i == 0)
+                        first = c_json_symbols_get(symbols, 0, NULL);
+        }
+        assert(!c_json_symbols_add(symbols, "key0", 4, &id) && id == 0);
+        assert(c_json_symbols_get(symbols, 0, NULL) == first);
+        c_json_symbols_freeze(symbols);
+        assert(c_json_symbols_add(symbols, "key1000", 7, NULL) == -ENOSPC);
+        assert(!c_json_symbols_add(symbols, "key999", 6, &id) && id == 999);
+
+        c_json_set_symbols(json, symbols);
+        c_json_begin_read(json, "{ \"key7\": 1, \"key1000\": 2 }");
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_key(json, &key, &id) && id == 7 && !strcmp(key, "key7"));
+        assert(!c_json_skip(json));
+        assert(!c_json_read_key(json, &key, &id) && id == C_JSON_KEY_NONE);
+        assert(!c_json_skip(json));
+        assert(!c_json_close_object(json));
+        assert(!c_json_end_read(json));
+        assert(c_json_symbols_count(symbols) == 1000);
+
+        json = c_json_free(json);
+}
+
+static void test_validate(void) {
+        static const char *const valid[] = {
+                "0", "-0.0e+0", "1E-7", " [ 1, \"a\\u00e9\", { \"k\": [ true, false, null ] } ] ",
+        };
+        static const char *const invalid[] = {
+                "", "]", "01", "-", "1.", "1e", "1e+", ".5", "[ 1, ]", "{ 1: 2 }", "\"\\x\"", "[] []",
+                "{\"a\":}", "[{\"a\":}]", "{\"a\":1,\"b\":}",
+        };
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        _c_cleanup_(c_freep) char *deep = NULL;
+        size_t n_deep = 100000;
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(valid); i += 1)
+                assert(!c_json_validate(valid[i], strlen(valid[i]), 16));
+        for (size_t i = 0; i < C_ARRAY_SIZE(invalid); i += 1)
+                assert(c_json_validate(invalid[i], strlen(invalid[i]), 16) == C_JSON_E_INVALID_JSON);
+
+        /* the nesting does not recurse, so it can be as deep as allowed */
+        deep = malloc(2 * n_deep);
+        assert(deep);
+        memset(deep, '[', n_deep);
+        memset(deep + n_deep, ']', n_deep);
+        assert(!c_json_validate(deep, 2 * n_deep, n_deep));
+        assert(c_json_validate(deep, 2 * n_deep, n_deep - 1) == C_JSON_E_DEPTH_OVERFLOW);
+        assert(c_json_validate(deep, 2 * n_deep - 1, n_deep) == C_JSON_E_INVALID_JSON);
+
+        /* an object cannot be closed in front of a value */
+        assert(!c_json_new(&json, 16));
+        c_json_begin_read(json, "{\"a\":}");
+        assert(!c_json_open_object(json));
+        assert(!c_json_read_string(json, NULL));
+        assert(c_json_more(json));
+        assert(c_json_close_object(json) == C_JSON_E_INVALID_JSON);
+        assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+}
+
+/* levels below the current one only keep their kind, see c_json_pop() */
+static void test_deep(void) {
+        _c_cleanup_(c_freep) char *input = NULL;
+        static CJson *json = NULL;
+        size_t n_deep = 1000, n = 0;
+        bool found;
+
+        /* alternates arrays and objects, with a member behind each one */
+        input = malloc(16 * n_deep);
+        assert(input);
+        for (size_t i = 0; i < n_deep; i += 1)
+                n += sprintf(input + n, i % 3 ? "[" : "{\"k\":");
+        n += sprintf(input + n, "0");
+        for (size_t i = n_deep; i-- > 0;)
+                n += sprintf(input + n, i % 3 ? ",1]" : ",\"x\":2}");
+
+        assert(!c_json_validate(input, n, n_deep));
+        assert(c_json_validate(input, n, n_deep - 1) == C_JSON_E_DEPTH_OVERFLOW);
+
+        assert(!c_json_new(&json, n_deep));
+        c_json_begin_read_n(json, input, n);
+        for (size_t i = 0; i < n_deep; i += 1) {
+                if (i % 3) {
+                        assert(!c_json_open_array(json));
+                } else {
+                        assert(!c_json_open_object(json));
+                        assert(!c_json_find_key(json, "k", 1, &found) && found);
+                }
+        }
+        assert(!c_json_read_u64(json, NULL));
+        for (size_t i = n_deep; i-- > 0;) {
+                if (i % 3) {
+                        assert(!c_json_read_u64(json, NULL));
+                        assert(!c_json_close_array(json));
+                } else {
+                        assert(!c_json_find_key(json, "x", 1, &found) && found);
+                        assert(!c_json_read_u64(json, NULL));
+                        assert(!c_json_close_object(json));
+                }
+        }
+        assert(!c_json_end_read(json));
+        json = c_json_free(json);
+}
+
+static void test_utf8(void) {
+        static const char *const valid[] = {
+                "\"\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80\xf4\x8f\xbf\xbf\xef\xbf\xbf\"",
+                "\"a long run of ascii before the first \xc3\xa9, and \xe2\x82\xac\\n behind an escape\"",
+                "{ \"k\xc3\xa9y\": [ \"\xed\x9f\xbf\", \"\xee\x80\x80\" ] }",
+        };
+        static const char *const invalid[] = {
+                "\"\x80\"", "\"\xc0\x80\"", "\"\xc1\xbf\"", "\"\xe0\x80\x80\"", "\"\xed\xa0\x80\"",
+                "\"\xf0\x80\x80\x80\"", "\"\xf4\x90\x80\x80\"", "\"\xf5\x80\x80\x80\"", "\"\xff\"",
+                "\"\xe2\x82\"", "\"\xe2\x82", "\"\xc3\\n\"", "{ \"\xc3\": 1 }",
+                "[ \"padding the string to the second block \xc3\xa4\xc3 and more\" ]",
+        };
+        static const unsigned int flags[] = { C_JSON_FLAG_UTF8, C_JSON_FLAG_UTF8 | C_JSON_FLAG_INDEX };
+        static CJson *json = NULL;
+        char buffer[512];
+        const char *string;
+        size_t n;
+
+        assert(!c_json_new(&json, 256));
+
+        for (size_t f = 0; f < C_ARRAY_SIZE(flags); f += 1) {
+                c_json_set_flags(json, flags[f]);
+
+                for (size_t i = 0; i < C_ARRAY_SIZE(valid); i += 1) {
+                        c_json_begin_read(json, valid[i]);
+                        assert(!c_json_skip(json));
+                        assert(!c_json_end_read(json));
+                }
+
+                /* whether strings are read or skipped, they are rejected */
+                for (size_t i = 0; i < C_ARRAY_SIZE(invalid); i += 1) {
+                        buffer[0] = '\0';
+                        c_json_begin_read(json, invalid[i]);
+                        walk_value(json, NULL, buffer);
+                        assert(c_json_end_read(json) == C_JSON_E_INVALID_JSON);
+                        c_json_reset(json);
+
+                        c_json_begin_read(json, invalid[i]);
+                        assert(c_json_skip(json) == C_JSON_E_INVALID_JSON);
+                        c_json_reset(json);
+                }
+        }
+
+        c_json_begin_read(json, valid[1]);
+        assert(!c_json_read_string_view(json, &string, &n));
+        assert(!c_json_end_read(json));
+        assert(n == 66 && !memcmp(string + 45, "\xe2\x82\xac\n", 4));
+
+        /* sequences split across fed input are completed */
+        c_json_set_flags(json, C_JSON_FLAG_UTF8);
+        for (size_t n_chunk = 1; n_chunk <= strlen(valid[0]); n_chunk += 1) {
+                Feeder f = { .json = json, .input = valid[0], .n_input = strlen(valid[0]), .n_chunk = n_chunk };
+
+                c_json_begin_feed(json);
+                while (feeder_next(&f) == C_JSON_E_AGAIN)
+                        ;
+                assert(!FEED(&f, c_json_read_string_view(json, &string, &n)) && n == 16);
+                while (!f.final)
+                        feeder_next(&f);
+                assert(!c_json_end_read(json));
+        }
+
+        /* without the flag, bytes are copied verbatim */
+        c_json_set_flags(json, 0);
+        c_json_begin_read(json, "\"\xff\xc0\x80\"");
+        assert(!c_json_read_string_view(json, &string, &n) && n == 3);
+        assert(!c_json_end_read(json));
+
+        json = c_json_free(json);
+}
+
 static void test_peek(void) {
         static CJson *json = NULL;
 
@@ -142,8 +1976,34 @@ static void test_peek(void) {
 
 int main(int argc, char **argv) {
         test_basic();
+        test_f64();
+        test_integer();
         test_array();
         test_object();
+        test_string_view();
+        test_string_scan();
+        test_space();
+        test_feed();
+        test_read_n();
+        test_skip();
+        test_find_key();
+        test_reset();
+        test_arena();
+        test_inplace();
+        test_file();
+        test_array_batch();
+        test_index();
+        test_documents();
+        test_dispatch();
+        test_write();
+        test_stats();
+        test_doc();
+        test_paths();
+        test_struct();
+        test_symbols();
+        test_validate();
+        test_deep();
+        test_utf8();
         test_peek();
         return 0;
 }
@@ -0,0 +1,556 @@
+/*
+ * Corpus Tests
+ *
+ * Runs every input through every way the library can read it, and checks
+ * that they all agree: the readers on the values they produce and the
+ * error they fail with, and the validators on the error alone. Inputs
+ * are read from the directories and files given on the command line,
+ * usually the JSONTestSuite files in test/, and those named y_, n_ or i_
+ * must also be accepted, rejected, or may go either way. Anything else,
+ * like the queue of a fuzzer, only has to give the same result
+ * everywhere. The time each backend takes is reported at the end.
+ *
+ * Built with C_JSON_FUZZ, this is a libFuzzer target instead, which runs
+ * the same checks on each input and aborts on a mismatch. AFL++ can run
+ * it as well, through its libFuzzer driver.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "c-json.h"
+
+#define MAX_DEPTH 256
+
+/* inputs up to this size are fed split at every position */
+#define SPLIT_ALL_MAX 4096
+#define SPLIT_SAMPLES 64
+
+/* returned by backends whose own runs disagree with each other */
+#define RESULT_INCONSISTENT INT_MIN
+
+/* inputs up to this size are also fed byte by byte */
+#define FEED_BYTES_MAX (64 * 1024)
+
+typedef struct Input {
+        const char *path;
+        const char *data;
+        size_t n_data;
+} Input;
+
+typedef struct Result {
+        int r;
+        char *out;
+        size_t n_out;
+} Result;
+
+static void result_clear(Result *result) {
+        free(result->out);
+        *result = (Result){};
+}
+
+/*
+ * Errors that depend on which reader noticed first, like a closing
+ * bracket where a value was expected, make the input invalid.
+ */
+static int result_code(int r) {
+        return (r == C_JSON_E_INVALID_TYPE || r == -1) ? C_JSON_E_INVALID_JSON : r;
+}
+
+typedef struct Feeder {
+        CJson *json;
+        const char *input;
+        size_t n_input;
+        size_t n_fed;
+        size_t split;
+        size_t n_chunk;
+        bool final;
+} Feeder;
+
+/*
+ * Feeds up to @split first, then in chunks of @n_chunk, then the end of
+ * the input. Keeps feeding until the start of the next value is buffered,
+ * so it can be peeked at.
+ */
+static void feeder_next(Feeder *f) {
+        size_t n;
+        int r;
+
+        do {
+                if (f->final)
+                        return;
+
+                n = f->n_fed < f->split ? f->split - f->n_fed : f->n_chunk;
+                n = c_min(n, f->n_input - f->n_fed);
+
+                r = c_json_feed(f->json, f->input + f->n_fed, n);
+                assert(r >= 0);
+                f->n_fed += n;
+                f->final = !n;
+        } while (r == C_JSON_E_AGAIN);
+}
+
+#define READ(_f, _call) ({                                                      \
+                int _r;                                                         \
+                while ((_r = (_call)) == C_JSON_E_AGAIN)                        \
+                        feeder_next(_f);                                        \
+                _r;                                                             \
+        })
+
+/*
+ * Reads the next value and writes a description of it to @out. Strings
+ * are written with their length, so any byte they contain is kept.
+ */
+static int walk_value(CJson *json, Feeder *f, FILE *out) {
+        const char *string;
+        double f64;
+        size_t n;
+        bool b;
+        int r;
+
+        switch (c_json_peek(json)) {
+                case C_JSON_TYPE_NULL:
+                        r = READ(f, c_json_read_null(json));
+                        if (!r)
+                                fputs("null ", out);
+                        return r;
+
+                case C_JSON_TYPE_BOOLEAN:
+                        r = READ(f, c_json_read_bool(json, &b));
+                        if (!r)
+                                fputs(b ? "true " : "false ", out);
+                        return r;
+
+                case C_JSON_TYPE_STRING:
+                        r = READ(f, c_json_read_string_view(json, &string, &n));
+                        if (!r) {
+                                fprintf(out, "%zu'", n);
+                                fwrite(string, 1, n, out);
+                                fputs("' ", out);
+                        }
+                        return r;
+
+                case C_JSON_TYPE_NUMBER:
+                        r = READ(f, c_json_read_f64(json, &f64));
+                        if (!r)
+                                fprintf(out, "%.17g ", f64);
+                        return r;
+
+                case C_JSON_TYPE_ARRAY:
+                        r = READ(f, c_json_open_array(json));
+                        if (r)
+                                return r;
+                        fputs("[ ", out);
+                        while (c_json_more(json)) {
+                                r = walk_value(json, f, out);
+                                if (r)
+                                        return r;
+                        }
+                        fputs("] ", out);
+                        return READ(f, c_json_close_array(json));
+
+                case C_JSON_TYPE_OBJECT:
+                        r = READ(f, c_json_open_object(json));
+                        if (r)
+                                return r;
+                        fputs("{ ", out);
+                        while (c_json_more(json)) {
+                                r = walk_value(json, f, out);
+                                if (!r)
+                                        r = walk_value(json, f, out);
+                                if (r)
+                                        return r;
+                        }
+                        fputs("} ", out);
+                        return READ(f, c_json_close_object(json));
+
+                default:
+                        return -1;
+        }
+}
+
+/* walks the document that @json has begun reading, and ends the read */
+static void walk(CJson *json, Feeder *f, Result *result) {
+        FILE *out;
+        int r;
+
+        out = open_memstream(&result->out, &result->n_out);
+        assert(out);
+
+        r = walk_value(json, f, out);
+
+        /* the rest only matters if it could still make the input invalid */
+        while (!r && f && !f->final)
+                feeder_next(f);
+
+        if (r)
+                c_json_end_read(json);
+        else
+                r = c_json_end_read(json);
+
+        fclose(out);
+        result->r = result_code(r);
+}
+
+static void read_flags(const Input *input, unsigned int flags, Result *result) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+
+        assert(!c_json_new(&json, MAX_DEPTH));
+        c_json_set_flags(json, flags);
+        c_json_begin_read_n(json, input->data, input->n_data);
+        walk(json, NULL, result);
+}
+
+static bool backend_default(const Input *input, Result *result) {
+        read_flags(input, 0, result);
+        return true;
+}
+
+static bool backend_index(const Input *input, Result *result) {
+        read_flags(input, C_JSON_FLAG_INDEX, result);
+        return true;
+}
+
+static bool backend_utf8(const Input *input, Result *result) {
+        read_flags(input, C_JSON_FLAG_UTF8, result);
+        return true;
+}
+
+static bool backend_inplace(const Input *input, Result *result) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        _c_cleanup_(c_freep) char *copy = NULL;
+
+        copy = malloc(input->n_data + 1);
+        assert(copy);
+        memcpy(copy, input->data, input->n_data);
+
+        assert(!c_json_new(&json, MAX_DEPTH));
+        c_json_begin_read_inplace(json, copy, input->n_data);
+        walk(json, NULL, result);
+        return true;
+}
+
+static bool backend_file(const Input *input, Result *result) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        _c_cleanup_(c_closep) int fd = -1;
+
+        /* fuzzer inputs only exist in memory */
+        if (!input->path)
+                return false;
+
+        fd = open(input->path, O_RDONLY | O_CLOEXEC);
+        assert(fd >= 0);
+
+        assert(!c_json_new(&json, MAX_DEPTH));
+        assert(!c_json_begin_read_file(json, fd));
+        walk(json, NULL, result);
+        return true;
+}
+
+static void feed(const Input *input, size_t split, size_t n_chunk, Result *result) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        Feeder f = {
+                .input = input->data,
+                .n_input = input->n_data,
+                .split = split,
+                .n_chunk = n_chunk,
+        };
+
+        assert(!c_json_new(&json, MAX_DEPTH));
+        f.json = json;
+        c_json_begin_feed(json);
+        feeder_next(&f);
+        walk(json, &f, result);
+}
+
+static int result_compare(const Result *a, const Result *b) {
+        if (a->r != b->r || a->n_out != b->n_out)
+                return 1;
+
+        return memcmp(a->out, b->out, a->n_out) != 0;
+}
+
+/*
+ * Feeds the input split in two at every position, or at a sample of them
+ * for larger inputs, followed by the rest at once. Reports the first
+ * split whose result differs from the first one.
+ */
+static bool backend_feed_split(const Input *input, Result *result) {
+        size_t n_splits = input->n_data <= SPLIT_ALL_MAX ? input->n_data + 1 : SPLIT_SAMPLES;
+        Result other = {};
+
+        feed(input, 0, SIZE_MAX, result);
+
+        for (size_t i = 1; i < n_splits; i += 1) {
+                size_t split = n_splits == SPLIT_SAMPLES ? input->n_data / SPLIT_SAMPLES * i : i;
+
+                feed(input, split, SIZE_MAX, &other);
+                if (result_compare(result, &other)) {
+                        fprintf(stderr, "split at %zu differs\n", split);
+                        result_clear(result);
+                        *result = other;
+                        result->r = RESULT_INCONSISTENT;
+                        return true;
+                }
+                result_clear(&other);
+        }
+
+        return true;
+}
+
+static bool backend_feed_bytes(const Input *input, Result *result) {
+        /* a byte at a time is quadratic in the length of strings */
+        if (input->n_data > FEED_BYTES_MAX)
+                return false;
+
+        feed(input, 0, 1, result);
+        return true;
+}
+
+static bool backend_validate(const Input *input, Result *result) {
+        result->r = result_code(c_json_validate(input->data, input->n_data, MAX_DEPTH));
+        return true;
+}
+
+static bool backend_skip_index(const Input *input, Result *result) {
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        int r;
+
+        assert(!c_json_new(&json, MAX_DEPTH));
+        c_json_set_flags(json, C_JSON_FLAG_INDEX);
+        c_json_begin_read_n(json, input->data, input->n_data);
+
+        r = c_json_skip(json);
+        if (r)
+                c_json_end_read(json);
+        else
+                r = c_json_end_read(json);
+
+        result->r = result_code(r);
+        return true;
+}
+
+static bool backend_doc(const Input *input, Result *result) {
+        _c_cleanup_(c_json_doc_freep) CJsonDoc *doc = NULL;
+        _c_cleanup_(c_json_freep) CJson *json = NULL;
+        int r;
+
+        assert(!c_json_new(&json, MAX_DEPTH));
+        assert(!c_json_doc_new(&doc));
+        c_json_begin_read_n(json, input->data, input->n_data);
+
+        r = c_json_doc_read(doc, json);
+        if (r)
+                c_json_end_read(json);
+        else
+                r = c_json_end_read(json);
+
+        result->r = result_code(r);
+        return true;
+}
+
+/*
+ * Backends that produce values must agree with the first one on them,
+ * the others only on the error. With C_JSON_FLAG_UTF8, the input may
+ * also be rejected because of the strings it contains.
+ */
+enum {
+        CHECK_VALUES,
+        CHECK_ERROR,
+        CHECK_UTF8,
+};
+
+static struct {
+        const char *name;
+        bool (*run)(const Input *input, Result *result);
+        unsigned int check;
+        uint64_t ns;
+        uint64_t n_bytes;
+} backends[] = {
+        { "default", backend_default, CHECK_VALUES },
+        { "index", backend_index, CHECK_VALUES },
+        { "inplace", backend_inplace, CHECK_VALUES },
+        { "file", backend_file, CHECK_VALUES },
+        { "feed-split", backend_feed_split, CHECK_VALUES },
+        { "feed-bytes", backend_feed_bytes, CHECK_VALUES },
+        { "utf8", backend_utf8, CHECK_UTF8 },
+        { "validate", backend_validate, CHECK_ERROR },
+        { "skip-index", backend_skip_index, CHECK_ERROR },
+        { "doc", backend_doc, CHECK_ERROR },
+};
+
+static uint64_t now(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool check_agrees(unsigned int check, char expect, const Result *expected, const Result *result) {
+        switch (check) {
+                case CHECK_VALUES:
+                        return !result_compare(expected, result);
+                case CHECK_ERROR:
+                        return expected->r == result->r;
+                case CHECK_UTF8:
+                        /* the suite keeps invalid UTF-8 out of y_ files */
+                        if (expect == 'y')
+                                return !result_compare(expected, result);
+                        if (expected->r)
+                                return result->r != 0;
+                        return !result_compare(expected, result) || result->r == C_JSON_E_INVALID_JSON;
+                default:
+                        return false;
+        }
+}
+
+/*
+ * Runs @input through all backends, with @expect being the prefix of a
+ * JSONTestSuite name, or 0 for inputs without an expected result.
+ *
+ * Return: true if all checks pass
+ */
+static bool check_input(const Input *input, char expect) {
+        Result expected = {}, result = {};
+        bool ok = true;
+        uint64_t start;
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(backends); i += 1) {
+                start = now();
+                if (!backends[i].run(input, i ? &result : &expected))
+                        continue;
+                backends[i].ns += now() - start;
+                backends[i].n_bytes += input->n_data;
+
+                if (i && !check_agrees(backends[i].check, expect, &expected, &result)) {
+                        fprintf(stderr, "%s: %s returns %d, default returns %d\n",
+                                input->path ?: "input", backends[i].name, result.r, expected.r);
+                        ok = false;
+                }
+                result_clear(&result);
+        }
+
+        switch (expect) {
+                case 'y':
+                        ok = ok && !expected.r;
+                        break;
+                case 'n':
+                        ok = ok && (expected.r == C_JSON_E_INVALID_JSON || expected.r == C_JSON_E_DEPTH_OVERFLOW);
+                        break;
+                default:
+                        break;
+        }
+
+        if (!ok)
+                fprintf(stderr, "%s: FAIL (%d)\n", input->path ?: "input", expected.r);
+
+        result_clear(&expected);
+
+        return ok;
+}
+
+#if defined(C_JSON_FUZZ)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t n_data) {
+        Input input = { .data = (const char *)data, .n_data = n_data };
+
+        if (!check_input(&input, 0))
+                abort();
+
+        return 0;
+}
+
+#else
+
+static bool check_file(const char *path) {
+        _c_cleanup_(c_fclosep) FILE *file = NULL;
+        _c_cleanup_(c_freep) char *data = NULL;
+        const char *name = strrchr(path, '/');
+        Input input = { .path = path };
+        char expect = 0;
+        int n;
+
+        name = name ? name + 1 : path;
+        if ((name[0] == 'y' || name[0] == 'n' || name[0] == 'i') && name[1] == '_')
+                expect = name[0];
+
+        file = fopen(path, "re");
+        assert(file);
+        assert(!fseek(file, 0, SEEK_END));
+        n = ftell(file);
+        assert(n >= 0);
+        rewind(file);
+
+        data = malloc(n + 1);
+        assert(data);
+        assert(fread(data, 1, n, file) == (size_t)n);
+
+        input.data = data;
+        input.n_data = n;
+
+        return check_input(&input, expect);
+}
+
+/* checks @path, or the .json files in it, and those without a suffix for fuzzer queues */
+static size_t check_path(const char *path, size_t *n_failedp) {
+        _c_cleanup_(c_closedirp) DIR *dir = NULL;
+        struct dirent *entry;
+        size_t n_files = 0;
+        char *suffix;
+
+        dir = opendir(path);
+        if (!dir) {
+                *n_failedp += !check_file(path);
+                return 1;
+        }
+
+        while ((entry = readdir(dir))) {
+                _c_cleanup_(c_freep) char *child = NULL;
+
+                if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+                        continue;
+                if (entry->d_name[0] == '.')
+                        continue;
+
+                suffix = strrchr(entry->d_name, '.');
+                if (suffix && strcmp(suffix, ".json"))
+                        continue;
+
+                assert(asprintf(&child, "%s/%s", path, entry->d_name) >= 0);
+                *n_failedp += !check_file(child);
+                n_files += 1;
+        }
+
+        return n_files;
+}
+
+int main(int argc, char **argv) {
+        size_t n_files = 0, n_failed = 0;
+
+        if (argc < 2) {
+                fprintf(stderr, "usage: %s PATH...\n", argv[0]);
+                return 2;
+        }
+
+        for (int i = 1; i < argc; i += 1)
+                n_files += check_path(argv[i], &n_failed);
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(backends); i += 1)
+                printf("%-16s %10.1f MB/s\n",
+                       backends[i].name,
+                       backends[i].ns ? backends[i].n_bytes * 1e3 / backends[i].ns : 0.0);
+
+        printf("%zu files, %zu failed\n", n_files, n_failed);
+
+        return n_failed ? 1 : 0;
+}
+
+#endif